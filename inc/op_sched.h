@@ -5,38 +5,224 @@
 
 #include "vm_settings.h"
 
+#define OP_MAX_LEVELS 8 // Most Ready levels an MLFQ schedule can have
+#define OP_INBOX_SIZE 1024 // Slots in a submission inbox (power of 2)
+#define OP_SEED_MIX 88172645463325252ULL // Mixed into op_set_seed's seed for the lottery draws (never 0)
+
+// Process State Bits (Op_process_s.state, the low 28 bits hold the Exit Code)
+#define CRITICAL_FLAG   (1 << 31)
+#define LOW_FLAG        (1 << 30)
+#define READY_FLAG      (1 << 29)
+#define DEFUNCT_FLAG    (1 << 28)
+
+// Observed Behavior (Op_process_s.bound, see op_observe)
+#define OP_BOUND_UNKNOWN 0 // Not sampled yet
+#define OP_BOUND_CPU     1 // Uses most of its slices
+#define OP_BOUND_IO      2 // Sleeps or blocks through most of its slices
+#define OP_BOUND_MIXED   3 // Started out between the two, keeps the plain quantum
+
 // Process Node Definition
 typedef struct process_node {
   pid_t pid; // PID of the Process you're Tracking
-  char *cmd; // Name of the Process being run
   unsigned int state; // Contains the State of the Process, Priority Flag, AND Exit Code (set by OS).
-  int age; // How long this has been in the Ready Queue - Low Priority since last run.
+  unsigned long age_tick; // Schedule tick when this last entered the Ready Queue - Low Priority.
+  int level; // Ready level this was last queued on (0 is the highest).
+  int last_core; // Host core this last ran on (-1 if it hasn't run yet).
+  int migrations; // Times this moved to a different host core between quanta.
+  int pinned; // 1 while the dispatcher has it pinned to a single host core (affinity mode).
+  unsigned int quanta; // Times this was dispatched.
+  unsigned long long submit_ns; // When this was created (op_now_ns clock).
+  unsigned long long ready_ns; // When this last joined the Ready Queues (op_add/op_requeue).
+  unsigned long long first_run_ns; // First dispatch (0 until it has run).
+  unsigned long long exit_ns; // When this exited or was terminated (0 while alive).
+  unsigned long long wait_ns; // Total time spent waiting in the Ready Queues.
+  unsigned long long low_wait_ns; // Part of wait_ns spent on the lowest level (Ready - Low).
+  unsigned long long cpu_ns; // CPU time actually used (sampled by the dispatcher each quantum).
+  unsigned long long stop_ns; // When the dispatcher last suspended this (0 before its first quantum).
+  int priority; // MIN_PRIORITY to MAX_PRIORITY (vm_process.h), higher gets a bigger share under the fair policy.
+  unsigned long long vruntime; // Weighted CPU time, ns at DEFAULT_PRIORITY (fair policy).
+  unsigned long long charged_ns; // Part of cpu_ns already charged to vruntime.
+  int heap_index; // Slot in a policy heap (-1 when not in one).
+  unsigned long heap_seq; // Heap arrival order, breaks ties first come first served.
+  int prio_level; // Effective priority under the prio policy (priority raised by aging).
+  unsigned long long deadline_ns; // Absolute deadline (op_now_ns clock), 0 if this isn't a deadline job.
+  unsigned long long relative_ns; // Deadline relative to submission (admission control charges runtime/relative).
+  unsigned long long runtime_ns; // CPU time the job expects to need before its deadline.
+  int edf; // 1 while it runs in the deadline class (a job that misses its deadline drops to the policy).
+  int tickets; // MIN_TICKETS to MAX_TICKETS (vm_process.h), CPU share under the stride and lottery policies.
+  unsigned long long pass; // Stride policy virtual time, the lowest pass runs next.
+  unsigned int busy_permille; // Running average of CPU time over wall time per slice (0-1000).
+  int bound; // OP_BOUND_UNKNOWN, OP_BOUND_CPU, OP_BOUND_IO or OP_BOUND_MIXED from busy_permille.
+  unsigned long long recheck_ns; // While parked, when it goes back to the Ready set (see op_park).
+  unsigned int parks; // Times this was found asleep when dispatched and parked.
   struct process_node *next; // Pointer to next Process Node in a linked list.
+  struct process_node *prev; // Pointer to previous Process Node (O(1) unlinking).
+  struct queue_header *queue; // Queue this node is linked into (NULL if on CPU).
+  char cmd[MAX_CMD]; // Name of the Process being run (inline, same block as the node)
 } Op_process_s;
 
 // Queue Header Definition
 typedef struct queue_header {
   int count; // How many items are in this linked list?
   Op_process_s *head; // Points to FIRST node of linked list.  No Dummy Nodes.
+  Op_process_s *tail; // Points to LAST node of linked list (O(1) appends).
 } Op_queue_s;
 
+// PID Index Definition (open addressing with linear probing)
+typedef struct pid_index {
+  int size;  // Number of slots, always a power of 2.
+  int count; // How many slots are in use?
+  Op_process_s **slots; // NULL marks an empty slot.  No Tombstones.
+} Op_pid_index_s;
+
+// Heap Definition (binary min-heap of processes, see op_heap_push)
+// Each process remembers its slot (heap_index) so any one of them can be removed in O(log n).
+typedef struct op_heap {
+  Op_process_s **items;
+  int count;
+  int size;
+  unsigned long seq; // Stamped on each push, equal keys leave first come first served
+  int (*before)(Op_process_s *a, Op_process_s *b); // 1 if a runs before b (compare keys only)
+} Op_heap_s;
+
+// Node Pool Statistics (see op_pool_stats)
+typedef struct pool_stats {
+  int live;  // Nodes handed out and not yet freed
+  int free;  // Nodes sitting on the free-list (always 0 without USE_NODE_POOL)
+  int peak;  // Most nodes ever live at once
+  int slabs; // Slabs allocated from the heap
+} Op_pool_stats_s;
+
+// Submission Inbox Definition (bounded lock-free MPSC ring, Vyukov style)
+// Any thread may push; only the thread holding the owning schedule's lock may pop.
+typedef struct inbox_cell {
+  unsigned long seq; // Ring position this cell is ready for (publishes process to the other side)
+  Op_process_s *process;
+} Op_inbox_cell_s;
+
+typedef struct inbox {
+  unsigned long head __attribute__((aligned(64))); // Next position a producer claims (CAS)
+  unsigned long tail __attribute__((aligned(64))); // Next position the consumer pops
+  Op_inbox_cell_s cells[OP_INBOX_SIZE] __attribute__((aligned(64)));
+} Op_inbox_s;
+
+// Multi-Level Feedback Queue Settings
+// The classic High/Low schedule is the special case {2, {1, 2}, 0, 0}.
+typedef struct mlfq_config {
+  int levels;                 // Number of Ready levels (2 to OP_MAX_LEVELS)
+  int quantum[OP_MAX_LEVELS]; // Runtime quantum multiplier for each level
+  int demote;                 // 1 to demote processes that use their whole quantum
+  int boost_ticks;            // Boost everything to level 0 every N ticks (0 = MAX_AGE aging of the lowest level)
+} Op_mlfq_s;
+
+// Scheduler Events (reported to the schedule's trace hook, see op_set_trace)
+enum { OP_EV_ADD, OP_EV_SELECT, OP_EV_PROMOTE, OP_EV_RESUME, OP_EV_SUSPEND, OP_EV_EXIT, OP_EV_TERMINATE, OP_EV_COUNT };
+#define OP_QUEUE_CRITICAL -1 // Queue number traced for the Critical Queue (levels are 0 and up)
+#define OP_QUEUE_DEFUNCT  -2 // Queue number traced for the Defunct Queue
+#define OP_QUEUE_DEADLINE -3 // Queue number traced for the Deadline (EDF) heap
+typedef void (*Op_trace_fn)(void *arg, int event, struct process_node *process);
+
+// Scheduling Policy (see op_set_policy)
+// The op_* calls keep everything every policy shares (PID index, state flags, wait accounting,
+//  tracing and the Defunct Queue).  A policy only decides where Ready processes wait and who runs next.
+struct op_schedule;
+typedef struct op_policy {
+  char *name;  // Name the shell selects it by
+  char *about; // One line description
+  int (*create)(struct op_schedule *schedule);  // Sets up schedule->policy_data. Returns 0 or -1.
+  int (*add)(struct op_schedule *schedule, Op_process_s *process); // Queues a new or returning process. Returns 0 or -1.
+  int (*requeue)(struct op_schedule *schedule, Op_process_s *process, int used_quantum); // Queues a process back from the CPU. Returns 0 or -1.
+  Op_process_s *(*select)(struct op_schedule *schedule); // Unlinks and returns the next process to run (NULL if none)
+  void (*tick)(struct op_schedule *schedule); // Once per dispatch (aging, boosts), schedule->tick already advanced
+  void (*exit)(struct op_schedule *schedule, Op_process_s *process); // A process that isn't queued left for good
+  void (*terminate)(struct op_schedule *schedule, Op_process_s *process); // Unlinks a queued process that is leaving for good
+  int (*quantum)(struct op_schedule *schedule, Op_process_s *process); // Runtime quantum multiplier for a selected process
+  void (*walk)(struct op_schedule *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg); // Visits every queued process
+  void (*destroy)(struct op_schedule *schedule); // Frees policy_data (every process has already been selected out)
+} Op_policy_s;
+
 // Schedule Header Definition
 typedef struct op_schedule {
-  Op_queue_s *ready_queue_high; // Linked List of Processes ready to Run on CPU (High Priority)
-  Op_queue_s *ready_queue_low;  // Linked List of Processes ready to Run on CPU (Low Priority)
+  Op_heap_s deadline_heap;          // Deadline jobs by absolute deadline (EDF), ahead of every policy
+  Op_queue_s *ready_queue_critical; // Linked List of Critical Processes ready to Run on CPU (Ahead of High)
+  Op_queue_s *ready_queue_high; // Linked List of Processes ready to Run on CPU (High Priority, level 0)
+  Op_queue_s *ready_queue_low;  // Linked List of Processes ready to Run on CPU (Low Priority, lowest level)
   Op_queue_s *defunct_queue;    // Linked List of Defunct Processes 
+  Op_queue_s *parked_queue;     // Linked List of Processes found asleep when dispatched (not Ready until op_unpark)
+  Op_pid_index_s *pid_index;    // PID -> Node for every Process in a Ready Queue
+  unsigned long tick;           // Aging clock, advanced once per op_promote_processes
+  Op_mlfq_s mlfq;               // Level count, quanta, demotion and boost settings
+  Op_queue_s *ready_queues[OP_MAX_LEVELS]; // Every Ready level, only the first mlfq.levels are used
+  Op_trace_fn trace;            // Called on every add/select/promote/exit/terminate (NULL for none)
+  void *trace_arg;              // Passed back to trace
+  Op_policy_s *policy;          // Orders the Ready processes (op_policy_mlfq by default)
+  unsigned long long seed;      // Seeds the lottery draws of the next policy set up (see op_set_seed)
+  void *policy_data;            // Private to the policy (the MLFQ policy uses the queues above)
 } Op_schedule_s;
 
+// Scheduling Policies (op_policies is NULL terminated, the first entry is the default)
+extern Op_policy_s op_policy_mlfq;
+extern Op_policy_s op_policy_rr;
+extern Op_policy_s op_policy_fair;
+extern Op_policy_s op_policy_prio;
+extern Op_policy_s op_policy_stride;
+extern Op_policy_s op_policy_lottery;
+extern Op_policy_s *op_policies[];
+
+// Queue Primitives (shared by all of the op_* functions)
+void op_queue_init(Op_queue_s *queue);
+void op_queue_push(Op_queue_s *queue, Op_process_s *process);
+Op_process_s *op_queue_pop(Op_queue_s *queue);
+void op_queue_remove(Op_queue_s *queue, Op_process_s *process);
+
+// Heap Primitives (the deadline class and the keyed policies)
+int op_heap_init(Op_heap_s *heap, int (*before)(Op_process_s *a, Op_process_s *b));
+int op_heap_push(Op_heap_s *heap, Op_process_s *process);
+Op_process_s *op_heap_pop(Op_heap_s *heap);
+void op_heap_remove(Op_heap_s *heap, Op_process_s *process);
+
+// Submission Inbox (lock-free producers, single consumer)
+void op_inbox_init(Op_inbox_s *inbox);
+int op_inbox_push(Op_inbox_s *inbox, Op_process_s *process);
+Op_process_s *op_inbox_pop(Op_inbox_s *inbox);
+int op_inbox_count(Op_inbox_s *inbox);
+int op_inbox_drain(Op_inbox_s *inbox, Op_schedule_s *schedule, int max);
+
 // Prototypes
+unsigned long long op_now_ns();
 Op_schedule_s *op_create(); 
 Op_process_s *op_new_process(char *command, pid_t pid, int is_low, int is_critical);
+void op_free_process(Op_process_s *process);
+int op_set_priority(Op_process_s *process, int priority);
+int op_set_tickets(Op_process_s *process, int tickets);
+int op_set_deadline(Op_process_s *process, unsigned long long relative_ns, unsigned long long runtime_ns);
+void op_pool_stats(Op_pool_stats_s *stats);
+void op_pool_release();
 int op_add(Op_schedule_s *schedule, Op_process_s *process);
 int op_get_count(Op_queue_s *queue);
+Op_process_s *op_find(Op_schedule_s *schedule, pid_t pid);
+int op_get_ready_count(Op_schedule_s *schedule);
 Op_process_s *op_select_high(Op_schedule_s *schedule);
 Op_process_s *op_select_low(Op_schedule_s *schedule);
+Op_process_s *op_select(Op_schedule_s *schedule);
+int op_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum);
+int op_get_quantum(Op_schedule_s *schedule, Op_process_s *process);
+void op_observe(Op_process_s *process, unsigned long long wall_ns, unsigned long long used_ns);
+long op_adapt_quantum(Op_schedule_s *schedule, Op_process_s *process, long usec);
+int op_set_mlfq(Op_schedule_s *schedule, Op_mlfq_s *config);
+void op_mlfq_classic(Op_mlfq_s *config);
 int op_promote_processes(Op_schedule_s *schedule);
+int op_get_age(Op_schedule_s *schedule, Op_process_s *process);
 int op_exited(Op_schedule_s *schedule, Op_process_s *process, int exit_code);
 int op_terminated(Op_schedule_s *schedule, pid_t pid, int exit_code);
+int op_park(Op_schedule_s *schedule, Op_process_s *process, unsigned long long recheck_ns);
+int op_unpark(Op_schedule_s *schedule, unsigned long long now_ns);
+int op_set_policy(Op_schedule_s *schedule, Op_policy_s *policy);
+void op_set_seed(Op_schedule_s *schedule, unsigned long long seed);
+Op_policy_s *op_find_policy(char *name);
+void op_walk_ready(Op_schedule_s *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg);
+void op_set_trace(Op_schedule_s *schedule, Op_trace_fn trace, void *arg);
+int op_trace_queue(Op_process_s *process);
 void op_deallocate(Op_schedule_s *schedule);
 
 #endif
@@ -10,6 +10,7 @@
 extern pthread_cond_t cs_cv;
 extern pthread_condattr_t cs_cvattr;
 extern pthread_mutex_t cs_cv_m;
+extern int debug_mode;
 
 // Prototypes
 void initialize_cs_system();
@@ -19,14 +20,35 @@ void cs_op_process(process_data_t *proc);
 void cs_op_terminated(pid_t pid, int exit_code);
 void cs_suspend(pid_t pid);
 void cs_resume(pid_t pid);
-void cs_exiting_process(int exit_code);
 void print_schedule();
 void print_op_queue(Op_queue_s *queue);
 void print_process_node(Op_process_s *node);
 void start_cs();
 void stop_cs();
 void toggle_cs();
+void set_cpus(int count);
+void toggle_affinity();
+void print_affinity_status();
+void toggle_adapt();
+void print_adapt_status();
+void toggle_probe();
+void print_probe_status();
 void print_cs_status();
-void set_run_usec(useconds_t time);
-void set_between_usec(useconds_t time);
+void print_pool_status();
+void set_mlfq(Op_mlfq_s *config);
+void print_mlfq_status();
+void set_policy(char *name);
+void print_policy_status();
+int cs_admit_deadline(long runtime_usec, long deadline_usec);
+void set_deadline_bound(long percent);
+void print_deadline_status();
+void set_run_usec(long time);
+void set_between_usec(long time);
+void print_cs_timing();
+void reset_cs_timing();
+void print_cs_stats();
+void print_cs_latency();
+void reset_cs_latency();
+void dump_cs_trace(char *path);
+void print_trace_status();
 #endif
@@ -7,6 +7,9 @@
 #define DEFAULT_PRIORITY 128
 #define MIN_PRIORITY 1
 #define MAX_PRIORITY 255
+#define DEFAULT_TICKETS 100
+#define MIN_TICKETS 1
+#define MAX_TICKETS 100000
 #define MAX_AGE 5
 
 typedef struct process_data {
@@ -18,6 +21,10 @@ typedef struct process_data {
   int is_critical; // 1 If the process is run with critical permissions
   pid_t pid;
   struct process_data *next;
+  int priority; // Share weight under the fair policy (-p N), MIN_PRIORITY to MAX_PRIORITY (kept last, libvm_sd knows the layout above)
+  long deadline_usec; // Relative deadline (-d), 0 if it isn't a deadline job
+  long runtime_usec; // Expected CPU time before the deadline (-r)
+  int tickets; // CPU share under the stride and lottery policies (-t N), MIN_TICKETS to MAX_TICKETS
 } process_data_t;
 
 // Prototypes
@@ -16,6 +16,50 @@
 // Time to wait between Context Switches before Running Next Process
 #define BETWEEN_USEC 1000000 // 1000000 = 1000ms = 1 sec
 
+// Number of virtual CPUs (dispatcher threads) at startup, change with the cpus command
+#define NUM_CPUS 1
+
+// Pin resumed processes to their virtual CPU's host core (1) or let Linux place them (0)
+#define DEFAULT_AFFINITY 0
+
+// Ticks between MLFQ priority boosts when the mlfq command doesn't give one
+#define MLFQ_BOOST_TICKS 50
+
+// Least CPU time the fair policy charges for a slice (like CFS's minimum granularity),
+//  so a job that sleeps through its slices can't keep the dispatcher to itself
+#define FAIR_MIN_CHARGE_USEC 10000 // 10ms
+
+// Deadline jobs (-d/-r) are admitted while their summed runtime/deadline stays under this
+//  percent of each CPU (EDF can meet every deadline up to 100%, the rest is dispatch overhead).
+//  Change it with the deadline command.
+#define DEADLINE_UTIL_PERCENT 90
+
+// Levels a waiting job rises each time it ages MAX_AGE ticks under the prio policy
+#define PRIO_AGE_LEVELS 8
+
+// Adaptive quantum (adapt command): each slice a job's CPU time over wall time is averaged in,
+//  at or below ADAPT_IO_PERMILLE it's I/O-bound and gets ADAPT_IO_PERCENT of the quantum,
+//  at or above ADAPT_CPU_PERMILLE it's CPU-bound and gets ADAPT_CPU_PERCENT (in between keeps its class,
+//  one that starts in between is Mixed and keeps the plain quantum).
+#define DEFAULT_ADAPT 1
+#define ADAPT_IO_PERMILLE 300
+#define ADAPT_CPU_PERMILLE 700
+#define ADAPT_IO_PERCENT 25
+#define ADAPT_CPU_PERCENT 200
+
+// Runnability probe (probe command): PARK_PROBE_USEC into each quantum the dispatcher checks the job,
+//  one found asleep (sleep()/blocked I/O) that used under half that time is parked and the next job runs.
+//  Parked jobs go back to their queue after PARK_RECHECK_USEC.  Quanta under 2x the probe aren't probed.
+#define DEFAULT_PROBE 1
+#define PARK_PROBE_USEC 5000     // 5ms
+#define PARK_RECHECK_USEC 50000  // 50ms
+
+// Set USE_NODE_POOL to 1 to take Scheduler nodes from a slab free-list or 0 for plain malloc.
+// (Can also be set at build time, eg. make POOL=0)
+#ifndef USE_NODE_POOL
+#define USE_NODE_POOL 1
+#endif
+
 
 //////////////////////////////////////////////////////////////////////
 //  Do not modify anything below this line. 
@@ -24,6 +68,10 @@
 #define MAX_CMD_LINE 256 // Max characters in a user input
 #define MAX_STATUS   512 // Max characters in a status message
 #define MAX_PROC 64  // Max Processes Runnable
+#define MAX_CPUS 64  // Max virtual CPUs (dispatcher threads)
+#define TRACE_EVENTS 65536 // Scheduler events kept in the trace ring (power of 2)
+#define INBOX_DRAIN_BATCH 64 // Most new processes a dispatcher moves from its inbox per iteration
+#define TIMING_SLACK_USEC 1000 // A quantum longer than configured + this counts as an overrun
 #define MAX_CMD  256 // Max size of a single command
 #define MAX_PATH 512 // Max size of a command with full absolute path
 #define MAX_ARGS 16  // Max number of args for a single shell command
@@ -0,0 +1,24 @@
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <sys/types.h>
+#include "vm_settings.h"
+#include "op_sched.h"
+
+// Trace Event Definition (one fixed-size slot of the ring, 24 bytes)
+typedef struct trace_event {
+  unsigned long long ts_ns; // op_now_ns clock
+  pid_t pid;
+  unsigned int seq;         // Low bits of (ring position + 1), written last so readers can spot torn slots
+  unsigned char event;      // OP_EV_* from op_sched.h
+  signed char queue;        // Level, OP_QUEUE_CRITICAL or OP_QUEUE_DEFUNCT
+  unsigned short cpu;       // Virtual CPU the event happened on
+} Trace_event_s;
+
+// Prototypes
+void trace_record(int event, int cpu, pid_t pid, int queue);
+unsigned long trace_count();
+void trace_clear();
+int trace_dump_chrome(char *path);
+
+#endif
@@ -0,0 +1,528 @@
+/*
+ * - bench_op_sched.c (Trilby VM)
+ * Microbenchmark suite for the Scheduler.
+ * - Times op_new_process, op_add, op_select_high, op_select_low, op_promote_processes,
+ *   op_terminated, op_exited, op_free_process and op_deallocate with 10 to 1M processes queued,
+ *   plus the CS thread's per-quantum cycle (select, promote, re-add) and trace_record.
+ * - policy_select_* and policy_cycle_* run select/re-add (and then aging too) through op_select and
+ *   op_requeue under each policy, processes spread over every priority and half of them Low.
+ * - Every row reports ns/op, heap allocations/op and CPU cycles/op (when perf counters are available).
+ * - op_deallocate is charged per process it frees, so its cost is comparable across sizes.
+ * - Output is a text table, CSV or JSON (-f) so runs can be diffed between versions.
+ * - Node allocation follows the node pool setting (make bench POOL=0 for plain malloc).
+ *
+ * eg. ./bench -f csv > before.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+// Local Includes
+#include "vm_support.h"
+#include "op_sched.h"
+#include "vm_process.h"
+#include "vm_trace.h"
+
+#define BENCH_OPS 200000 // Timed operations per row (at least; one full pass at the larger sizes)
+#define BENCH_MAX_N 1000000
+#define BENCH_CALIBRATE 10000 // Empty start/stop pairs timed to find the measurement overhead
+
+int debug_mode = 0; // Keeps print_debug quiet while timing
+
+// One row of results, summed over every timed batch
+typedef struct bench_row {
+  double ns;
+  double cycles;
+  unsigned long allocs;
+  unsigned long ops;
+} Bench_row_s;
+
+// Snapshot taken by bench_start
+typedef struct bench_mark {
+  double ns;
+  long long cycles;
+  unsigned long allocs;
+} Bench_mark_s;
+
+// Globals
+static unsigned long bench_allocs = 0; // Heap allocations made so far (counted by the --wrap hooks)
+static int bench_perf_fd = -1;         // Cycle counter, -1 when perf events are unavailable
+static double bench_ns_overhead = 0;   // Cost of one empty start/stop pair
+static double bench_cycle_overhead = 0;
+static char bench_format = 't';        // 't'ext, 'c'sv or 'j'son
+static int bench_rows = 0;             // Rows printed so far (for JSON commas)
+static unsigned long bench_rng = 88172645463325252ULL;
+
+// Local Prototypes
+static double now_ns();
+static long long read_cycles();
+static void bench_start(Bench_mark_s *mark);
+static void bench_stop(Bench_mark_s *mark, Bench_row_s *row, unsigned long ops);
+static void bench_calibrate();
+static void bench_report(char *name, int n, Bench_row_s *row);
+static Op_process_s **bench_fill(Op_schedule_s *schedule, int n, int is_low, Bench_row_s *new_row, Bench_row_s *add_row);
+static void bench_lifecycle(int n, int ops);
+static void bench_select_low(int n, int ops);
+static void bench_promote(int n, int ops);
+static void bench_cycle(int n, int ops);
+static void bench_select_critical(int n, int critical, int ops, char *name);
+static void bench_policy_cycle(int n, int ops, Op_policy_s *policy);
+static void bench_trace(int ops);
+static void bench_usage(char *name);
+
+// Heap allocation counters.  The bench is linked with -Wl,--wrap so every malloc in op_sched lands here.
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  bench_allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  bench_allocs++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  bench_allocs++;
+  return __real_realloc(ptr, size);
+}
+
+int main(int argc, char *argv[]) {
+  struct perf_event_attr attr;
+  int max_n = BENCH_MAX_N, ops = BENCH_OPS, opt = 0, n = 0;
+
+  while((opt = getopt(argc, argv, "f:n:o:h")) != -1) {
+    switch(opt) {
+      case 'f': bench_format = optarg[0]; break;
+      case 'n': max_n = atoi(optarg); break;
+      case 'o': ops = atoi(optarg); break;
+      default: bench_usage(argv[0]); return 1;
+    }
+  }
+  if(strchr("tcj", bench_format) == NULL || max_n < 10 || ops < 1) {
+    bench_usage(argv[0]);
+    return 1;
+  }
+
+  // User-space cycle counter for this thread, if the kernel lets us have one
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  bench_perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if(bench_perf_fd >= 0) {
+    ioctl(bench_perf_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(bench_perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  bench_calibrate();
+
+  if(bench_format == 'c') {
+    printf("op,n,ops,ns_per_op,allocs_per_op,cycles_per_op,pool\n");
+  }
+  else if(bench_format == 'j') {
+    printf("{\"pool\":%d,\"cycles\":%s,\"overhead_ns\":%.1f,\"results\":[", USE_NODE_POOL,
+        (bench_perf_fd >= 0) ? "true" : "false", bench_ns_overhead);
+  }
+  else {
+    printf("node pool %s | cycles %s | %.1f ns timer overhead subtracted\n",
+        USE_NODE_POOL ? "on" : "off (malloc)", (bench_perf_fd >= 0) ? "on" : "unavailable", bench_ns_overhead);
+    printf("%-24s %10s %12s %12s %12s\n", "op", "queued", "ns/op", "allocs/op", "cycles/op");
+  }
+
+  for(n = 10; n <= max_n; n *= 10) {
+    bench_lifecycle(n, ops);
+    bench_select_low(n, ops);
+    bench_promote(n, ops);
+    bench_cycle(n, ops);
+    bench_select_critical(n, 1, ops, "op_select_high_1crit");
+    bench_select_critical(n, n / 2, ops, "op_select_high_halfcrit");
+    bench_policy_cycle(n, ops, &op_policy_mlfq);
+    bench_policy_cycle(n, ops, &op_policy_prio);
+  }
+  bench_trace(ops);
+
+  if(bench_format == 'j') {
+    printf("\n]}\n");
+  }
+  if(bench_perf_fd >= 0) {
+    close(bench_perf_fd);
+  }
+  op_pool_release();
+  return 0;
+}
+
+// Monotonic clock in nanoseconds
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Cycles this thread has spent in user space (0 without perf events)
+static long long read_cycles() {
+  long long cycles = 0;
+
+  if(bench_perf_fd < 0 || read(bench_perf_fd, &cycles, sizeof(cycles)) != sizeof(cycles)) {
+    return 0;
+  }
+  return cycles;
+}
+
+static void bench_start(Bench_mark_s *mark) {
+  mark->allocs = bench_allocs;
+  mark->cycles = read_cycles();
+  mark->ns = now_ns();
+}
+
+// Adds the batch since bench_start (less the measurement overhead) to row
+static void bench_stop(Bench_mark_s *mark, Bench_row_s *row, unsigned long ops) {
+  double ns = now_ns() - mark->ns - bench_ns_overhead;
+  double cycles = (double)(read_cycles() - mark->cycles) - bench_cycle_overhead;
+
+  row->ns += (ns > 0) ? ns : 0;
+  row->cycles += (cycles > 0) ? cycles : 0;
+  row->allocs += bench_allocs - mark->allocs;
+  row->ops += ops;
+}
+
+// Measures an empty start/stop pair so small batches aren't dominated by the clock reads
+static void bench_calibrate() {
+  Bench_row_s row = {0};
+  Bench_mark_s mark;
+
+  for(int i = 0; i < BENCH_CALIBRATE; i++) {
+    bench_start(&mark);
+    bench_stop(&mark, &row, 1);
+  }
+  bench_ns_overhead = row.ns / BENCH_CALIBRATE;
+  bench_cycle_overhead = row.cycles / BENCH_CALIBRATE;
+}
+
+// Prints one row in the chosen format
+static void bench_report(char *name, int n, Bench_row_s *row) {
+  double ops = (row->ops > 0) ? (double)row->ops : 1;
+  char cycles[32] = {0};
+
+  if(bench_perf_fd >= 0) {
+    snprintf(cycles, sizeof(cycles), "%.1f", row->cycles / ops);
+  }
+  if(bench_format == 'c') {
+    printf("%s,%d,%lu,%.2f,%.4f,%s,%d\n", name, n, row->ops, row->ns / ops, row->allocs / ops, cycles, USE_NODE_POOL);
+  }
+  else if(bench_format == 'j') {
+    printf("%s\n{\"op\":\"%s\",\"n\":%d,\"ops\":%lu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.4f,\"cycles_per_op\":%s}",
+        bench_rows ? "," : "", name, n, row->ops, row->ns / ops, row->allocs / ops, cycles[0] ? cycles : "null");
+  }
+  else {
+    printf("%-24s %10d %12.1f %12.4f %12s\n", name, n, row->ns / ops, row->allocs / ops, cycles[0] ? cycles : "-");
+  }
+  bench_rows++;
+  fflush(stdout);
+}
+
+// Creates n processes and adds them to schedule, timing each half into new_row and add_row (either may be NULL)
+static Op_process_s **bench_fill(Op_schedule_s *schedule, int n, int is_low, Bench_row_s *new_row, Bench_row_s *add_row) {
+  Op_process_s **procs = malloc(n * sizeof(Op_process_s *));
+  Bench_mark_s mark;
+  int i = 0;
+
+  if(procs == NULL) {
+    abort_error("...Could not allocate the process array!", __FILE__);
+  }
+
+  bench_start(&mark);
+  for(i = 0; i < n; i++) {
+    procs[i] = op_new_process("bench", i + 1, is_low, 0);
+  }
+  if(new_row != NULL) {
+    bench_stop(&mark, new_row, n);
+  }
+  for(i = 0; i < n; i++) {
+    if(procs[i] == NULL) {
+      abort_error("...op_new_process returned NULL!", __FILE__);
+    }
+  }
+
+  bench_start(&mark);
+  for(i = 0; i < n; i++) {
+    op_add(schedule, procs[i]);
+  }
+  if(add_row != NULL) {
+    bench_stop(&mark, add_row, n);
+  }
+  return procs;
+}
+
+// A process's whole life with n queued: new, add, select_high, terminate (by PID, random order) and deallocate
+static void bench_lifecycle(int n, int ops) {
+  Bench_row_s new_row = {0}, add_row = {0}, select_row = {0}, term_row = {0}, dealloc_row = {0};
+  Bench_mark_s mark;
+  Op_process_s **procs = NULL;
+  Op_schedule_s *schedule = NULL;
+  pid_t *pids = malloc(n * sizeof(pid_t));
+  int i = 0, j = 0;
+
+  if(pids == NULL) {
+    abort_error("...Could not allocate the PID array!", __FILE__);
+  }
+
+  while(new_row.ops < (unsigned long)ops) {
+    schedule = op_create();
+    if(schedule == NULL) {
+      abort_error("...op_create returned NULL!", __FILE__);
+    }
+    procs = bench_fill(schedule, n, 0, &new_row, &add_row);
+
+    bench_start(&mark);
+    for(i = 0; i < n; i++) {
+      op_select_high(schedule);
+    }
+    bench_stop(&mark, &select_row, n);
+
+    // Back in, then terminate them in a shuffled order so the PID index lookups don't walk memory in order
+    for(i = 0; i < n; i++) {
+      op_add(schedule, procs[i]);
+      pids[i] = i + 1;
+    }
+    for(i = n - 1; i > 0; i--) {
+      bench_rng ^= bench_rng << 13;
+      bench_rng ^= bench_rng >> 7;
+      bench_rng ^= bench_rng << 17;
+      j = bench_rng % (i + 1);
+      pid_t swap = pids[i];
+      pids[i] = pids[j];
+      pids[j] = swap;
+    }
+    bench_start(&mark);
+    for(i = 0; i < n; i++) {
+      op_terminated(schedule, pids[i], 0);
+    }
+    bench_stop(&mark, &term_row, n);
+
+    bench_start(&mark);
+    op_deallocate(schedule);
+    bench_stop(&mark, &dealloc_row, n);
+    free(procs);
+  }
+  free(pids);
+
+  bench_report("op_new_process", n, &new_row);
+  bench_report("op_add", n, &add_row);
+  bench_report("op_select_high", n, &select_row);
+  bench_report("op_terminated", n, &term_row);
+  bench_report("op_deallocate", n, &dealloc_row);
+}
+
+// Drains n Low processes with op_select_low, then frees each one with op_free_process
+static void bench_select_low(int n, int ops) {
+  Bench_row_s select_row = {0}, free_row = {0};
+  Bench_mark_s mark;
+  Op_process_s **procs = NULL;
+  Op_schedule_s *schedule = NULL;
+  int i = 0;
+
+  while(select_row.ops < (unsigned long)ops) {
+    schedule = op_create();
+    if(schedule == NULL) {
+      abort_error("...op_create returned NULL!", __FILE__);
+    }
+    procs = bench_fill(schedule, n, 1, NULL, NULL);
+
+    bench_start(&mark);
+    for(i = 0; i < n; i++) {
+      op_select_low(schedule);
+    }
+    bench_stop(&mark, &select_row, n);
+
+    bench_start(&mark);
+    for(i = 0; i < n; i++) {
+      op_free_process(procs[i]);
+    }
+    bench_stop(&mark, &free_row, n);
+
+    op_deallocate(schedule);
+    free(procs);
+  }
+
+  bench_report("op_select_low", n, &select_row);
+  bench_report("op_free_process", n, &free_row);
+}
+
+// Times op_promote_processes with n Low processes aged one tick apart, so every call promotes exactly one
+static void bench_promote(int n, int ops) {
+  Bench_row_s row = {0};
+  Bench_mark_s mark;
+  Op_process_s **procs = NULL;
+  Op_schedule_s *schedule = NULL;
+  int i = 0;
+
+  while(row.ops < (unsigned long)ops) {
+    schedule = op_create();
+    if(schedule == NULL) {
+      abort_error("...op_create returned NULL!", __FILE__);
+    }
+    procs = bench_fill(schedule, n, 1, NULL, NULL);
+    for(i = 0; i < n; i++) {
+      procs[i]->age_tick = schedule->tick + i;
+    }
+    while(op_get_count(schedule->ready_queue_high) == 0) { // Age the head until it is the first one promoted
+      op_promote_processes(schedule);
+    }
+
+    bench_start(&mark);
+    for(i = 1; i < n; i++) {
+      op_promote_processes(schedule);
+    }
+    bench_stop(&mark, &row, n - 1);
+
+    op_deallocate(schedule);
+    free(procs);
+  }
+
+  bench_report("op_promote_processes", n, &row);
+}
+
+// The CS thread's per-quantum cycle (select, age, put back) with n Low processes, then exits into a growing Defunct Queue
+static void bench_cycle(int n, int ops) {
+  Bench_row_s cycle_row = {0}, exit_row = {0};
+  Bench_mark_s mark;
+  Op_process_s **procs = NULL;
+  Op_process_s *proc = NULL;
+  Op_schedule_s *schedule = op_create();
+  int i = 0;
+
+  if(schedule == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+  procs = bench_fill(schedule, n, 1, NULL, NULL);
+
+  bench_start(&mark);
+  for(i = 0; i < ops; i++) {
+    proc = op_select_high(schedule);
+    if(proc == NULL) {
+      proc = op_select_low(schedule);
+    }
+    op_promote_processes(schedule);
+    op_add(schedule, proc);
+  }
+  bench_stop(&mark, &cycle_row, ops);
+
+  bench_start(&mark);
+  for(i = 0; i < n; i++) {
+    proc = op_select_high(schedule);
+    if(proc == NULL) {
+      proc = op_select_low(schedule);
+    }
+    op_exited(schedule, proc, 0);
+  }
+  bench_stop(&mark, &exit_row, n);
+
+  op_deallocate(schedule);
+  free(procs);
+  bench_report("dispatch_cycle", n, &cycle_row);
+  bench_report("op_exited", n, &exit_row);
+}
+
+// Times op_select_high + op_add with n High processes, `critical` of them Critical
+static void bench_select_critical(int n, int critical, int ops, char *name) {
+  Bench_row_s row = {0};
+  Bench_mark_s mark;
+  Op_schedule_s *schedule = op_create();
+  Op_process_s *proc = NULL;
+  int i = 0;
+
+  if(schedule == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+
+  // Critical processes are spread through the queue, not bunched at the head
+  for(i = 0; i < n; i++) {
+    proc = op_new_process("bench", i + 1, 0, critical > 0 && (i % (n / critical)) == n / critical - 1);
+    if(proc == NULL) {
+      abort_error("...op_new_process returned NULL!", __FILE__);
+    }
+    op_add(schedule, proc);
+  }
+
+  bench_start(&mark);
+  for(i = 0; i < ops; i++) {
+    proc = op_select_high(schedule);
+    op_add(schedule, proc);
+  }
+  bench_stop(&mark, &row, ops);
+
+  op_deallocate(schedule);
+  bench_report(name, n, &row);
+}
+
+// Times op_select + op_requeue, then the same with op_promote_processes (aging) in between,
+//  under policy with n processes, priorities spread over MIN_PRIORITY..MAX_PRIORITY and every other one Low
+static void bench_policy_cycle(int n, int ops, Op_policy_s *policy) {
+  Bench_row_s select_row = {0}, row = {0};
+  Bench_mark_s mark;
+  Op_schedule_s *schedule = op_create();
+  Op_process_s *proc = NULL;
+  char name[32] = {0};
+  int i = 0;
+
+  if(schedule == NULL || op_set_policy(schedule, policy) != 0) {
+    abort_error("...Could not set up the policy!", __FILE__);
+  }
+  for(i = 0; i < n; i++) {
+    proc = op_new_process("bench", i + 1, i & 1, 0);
+    if(proc == NULL) {
+      abort_error("...op_new_process returned NULL!", __FILE__);
+    }
+    op_set_priority(proc, MIN_PRIORITY + i % (MAX_PRIORITY - MIN_PRIORITY + 1));
+    op_add(schedule, proc);
+  }
+
+  bench_start(&mark);
+  for(i = 0; i < ops; i++) {
+    proc = op_select(schedule);
+    op_requeue(schedule, proc, 1);
+  }
+  bench_stop(&mark, &select_row, ops);
+
+  bench_start(&mark);
+  for(i = 0; i < ops; i++) {
+    proc = op_select(schedule);
+    op_promote_processes(schedule);
+    op_requeue(schedule, proc, 1);
+  }
+  bench_stop(&mark, &row, ops);
+
+  op_deallocate(schedule);
+  snprintf(name, sizeof(name), "policy_select_%s", policy->name);
+  bench_report(name, n, &select_row);
+  snprintf(name, sizeof(name), "policy_cycle_%s", policy->name);
+  bench_report(name, n, &row);
+}
+
+// Times trace_record, the cost every traced scheduler event adds
+static void bench_trace(int ops) {
+  Bench_row_s row = {0};
+  Bench_mark_s mark;
+
+  trace_clear();
+  bench_start(&mark);
+  for(int i = 0; i < ops; i++) {
+    trace_record(OP_EV_SELECT, 0, i + 1, 0);
+  }
+  bench_stop(&mark, &row, ops);
+  bench_report("trace_record", 0, &row);
+}
+
+static void bench_usage(char *name) {
+  fprintf(stderr, "usage: %s [-f text|csv|json] [-n max queued (10 to 1M)] [-o timed ops per row]\n", name);
+}
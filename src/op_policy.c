@@ -0,0 +1,514 @@
+/*
+ * - op_policy.c (Trilby VM)
+ * Scheduling policies other than the default MLFQ (see Op_policy_s in op_sched.h).
+ * - Each policy only orders the Ready processes; op_sched.c does the shared bookkeeping
+ *   (PID index, state flags, wait accounting, tracing and the Defunct Queue).
+ * - Add a new policy to op_policies in op_sched.c so the shell can select it.
+ */
+
+// System Includes
+#include <stdio.h>
+#include <stdlib.h>
+// Local Includes
+#include "op_sched.h"
+#include "vm_process.h"
+
+// Fair Policy State
+typedef struct fair_data {
+  Op_heap_s heap;
+  unsigned long long min_vruntime; // Never goes backwards, every process fair_add takes starts here
+} Fair_data_s;
+
+#define STRIDE_ONE (1ULL << 32) // Pass a single ticket advances per quantum (stride = STRIDE_ONE / tickets)
+
+// Stride and Lottery Policy State
+typedef struct stride_data {
+  Op_heap_s heap; // By pass (stride), or just the set of Ready processes (lottery)
+  unsigned long long global_pass; // Pass of the last process selected, never goes backwards
+  unsigned long long tickets; // Tickets held by the processes in heap
+  unsigned long long rng; // xorshift64 state for lottery draws
+} Stride_data_s;
+
+#define PRIO_WORDS ((MAX_PRIORITY + 64) / 64) // Bitmap words covering levels 0 to MAX_PRIORITY
+
+// Prio Policy State
+typedef struct prio_data {
+  Op_queue_s critical; // Critical processes run before every level
+  Op_queue_s levels[MAX_PRIORITY + 1]; // One FIFO per priority, index is the effective priority
+  unsigned long long bitmap[PRIO_WORDS]; // Bit L is set while levels[L] is non-empty
+  unsigned long long aging[MAX_AGE][PRIO_WORDS]; // Levels aged on each tick (L % MAX_AGE == tick % MAX_AGE)
+} Prio_data_s;
+
+
+/* Round Robin: one FIFO for every process, priorities ignored and every quantum the same length.
+ */
+static int rr_create(Op_schedule_s *schedule) {
+  Op_queue_s *queue = malloc(sizeof(Op_queue_s));
+
+  if(queue == NULL) {
+    return -1;
+  }
+
+  op_queue_init(queue);
+  schedule->policy_data = queue;
+  return 0;
+}
+
+static int rr_add(Op_schedule_s *schedule, Op_process_s *process) {
+  process->level = 0;
+  op_queue_push(schedule->policy_data, process);
+  return 0;
+}
+
+static int rr_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum) {
+  return rr_add(schedule, process);
+}
+
+static Op_process_s *rr_select(Op_schedule_s *schedule) {
+  return op_queue_pop(schedule->policy_data);
+}
+
+static void rr_tick(Op_schedule_s *schedule) {
+}
+
+static void rr_exit(Op_schedule_s *schedule, Op_process_s *process) {
+}
+
+static void rr_terminate(Op_schedule_s *schedule, Op_process_s *process) {
+  op_queue_remove(schedule->policy_data, process);
+}
+
+static int rr_quantum(Op_schedule_s *schedule, Op_process_s *process) {
+  return 1;
+}
+
+static void rr_walk(Op_schedule_s *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg) {
+  Op_queue_s *queue = schedule->policy_data;
+
+  for(Op_process_s *walker = queue->head; walker != NULL; walker = walker->next) {
+    visit(arg, walker);
+  }
+}
+
+static void rr_destroy(Op_schedule_s *schedule) {
+  free(schedule->policy_data);
+  schedule->policy_data = NULL;
+}
+
+Op_policy_s op_policy_rr = {"rr", "Round Robin, one FIFO, priorities ignored",
+  rr_create, rr_add, rr_requeue, rr_select, rr_tick, rr_exit, rr_terminate, rr_quantum, rr_walk, rr_destroy};
+
+
+/* Fair (CFS style): every process runs in order of its weighted virtual runtime.
+ * - A slice adds the CPU time actually used (cpu_ns, at least FAIR_MIN_CHARGE_USEC) to vruntime,
+ *   scaled by DEFAULT_PRIORITY's weight over the process's weight.
+ * - The lowest vruntime always runs next, so CPU bound processes at the same priority stay within
+ *   one slice of each other and their shares converge to exactly equal.
+ * - Weights double every 16 priority levels (about 4.4% per level), so 144 vs 128 gets 2x the CPU.
+ * - Anyone joining (new, stolen from another CPU or moved from another policy) starts at min_vruntime,
+ *   so it can't bank credit and starve the rest, or be starved by them.
+ */
+static const unsigned int fair_steps[16] = {1024, 1069, 1117, 1166, 1218, 1272, 1328, 1387, 1448, 1512, 1579, 1649, 1722, 1798, 1878, 1961}; // 1024 * 2^(i/16)
+
+static unsigned long long fair_weight(int priority) {
+  int step = priority - MIN_PRIORITY;
+
+  if(step < 0) {
+    step = 0;
+  }
+  if(step > MAX_PRIORITY - MIN_PRIORITY) {
+    step = MAX_PRIORITY - MIN_PRIORITY;
+  }
+  return (unsigned long long)fair_steps[step & 15] << (step >> 4);
+}
+
+static int fair_before(Op_process_s *a, Op_process_s *b) {
+  return a->vruntime < b->vruntime;
+}
+
+static int fair_create(Op_schedule_s *schedule) {
+  Fair_data_s *fair = malloc(sizeof(Fair_data_s));
+
+  if(fair == NULL) {
+    return -1;
+  }
+  if(op_heap_init(&fair->heap, fair_before) != 0) {
+    free(fair);
+    return -1;
+  }
+  fair->min_vruntime = 0;
+  schedule->policy_data = fair;
+  return 0;
+}
+
+static int fair_add(Op_schedule_s *schedule, Op_process_s *process) {
+  Fair_data_s *fair = schedule->policy_data;
+
+  process->level = 0;
+  process->charged_ns = process->cpu_ns; // Anything before it joined was charged elsewhere
+  process->vruntime = fair->min_vruntime; // Credit or debt from another CPU's clock means nothing here
+  return op_heap_push(&fair->heap, process);
+}
+
+/* Charges the slice just run, then queues the process by its new vruntime.
+ */
+static int fair_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum) {
+  Fair_data_s *fair = schedule->policy_data;
+  unsigned long long used = 0;
+
+  if(process->cpu_ns > process->charged_ns) {
+    used = process->cpu_ns - process->charged_ns;
+  }
+  if(used < FAIR_MIN_CHARGE_USEC * 1000ULL) {
+    used = FAIR_MIN_CHARGE_USEC * 1000ULL;
+  }
+  process->charged_ns = process->cpu_ns;
+  process->vruntime += used * fair_weight(DEFAULT_PRIORITY) / fair_weight(process->priority);
+  return op_heap_push(&fair->heap, process);
+}
+
+static Op_process_s *fair_select(Op_schedule_s *schedule) {
+  Fair_data_s *fair = schedule->policy_data;
+  Op_process_s *process = op_heap_pop(&fair->heap);
+
+  if(process != NULL && process->vruntime > fair->min_vruntime) {
+    fair->min_vruntime = process->vruntime;
+  }
+  return process;
+}
+
+static void fair_tick(Op_schedule_s *schedule) {
+}
+
+static void fair_exit(Op_schedule_s *schedule, Op_process_s *process) {
+}
+
+static void fair_terminate(Op_schedule_s *schedule, Op_process_s *process) {
+  Fair_data_s *fair = schedule->policy_data;
+  op_heap_remove(&fair->heap, process);
+}
+
+static int fair_quantum(Op_schedule_s *schedule, Op_process_s *process) {
+  return 1;
+}
+
+static void fair_walk(Op_schedule_s *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg) {
+  Fair_data_s *fair = schedule->policy_data;
+
+  for(int i = 0; i < fair->heap.count; i++) {
+    visit(arg, fair->heap.items[i]);
+  }
+}
+
+static void fair_destroy(Op_schedule_s *schedule) {
+  Fair_data_s *fair = schedule->policy_data;
+  free(fair->heap.items);
+  free(fair);
+  schedule->policy_data = NULL;
+}
+
+Op_policy_s op_policy_fair = {"fair", "CFS style, least weighted CPU time runs next, -p sets the weight",
+  fair_create, fair_add, fair_requeue, fair_select, fair_tick, fair_exit, fair_terminate, fair_quantum, fair_walk, fair_destroy};
+
+
+/* Prio (O(1) bitmap, like Linux 2.6's O(1) scheduler): one FIFO per priority level, highest runs first.
+ * - A bitmap of non-empty levels finds the highest one with a count-leading-zeros per word,
+ *   so select costs the same with 10 or 1M processes queued.
+ * - Critical processes still run before every level.
+ * - Aging works like op_promote_processes: a process waiting MAX_AGE ticks rises PRIO_AGE_LEVELS
+ *   levels (up to MAX_PRIORITY), and drops back to its own priority once it has run.
+ * - Each tick only ages a fifth of the levels (every level once per MAX_AGE ticks), and only their heads,
+ *   so aging costs the same however deep the levels are.
+ */
+static void prio_push(Prio_data_s *prio, Op_schedule_s *schedule, Op_process_s *process, int level) {
+  process->prio_level = level;
+  process->age_tick = schedule->tick;
+  op_queue_push(&prio->levels[level], process);
+  prio->bitmap[level >> 6] |= 1ULL << (level & 63);
+}
+
+/* Returns the highest non-empty level, or -1 if every level is empty.
+ */
+static int prio_highest(Prio_data_s *prio) {
+  for(int word = PRIO_WORDS - 1; word >= 0; word--) {
+    if(prio->bitmap[word] != 0) {
+      return word * 64 + 63 - __builtin_clzll(prio->bitmap[word]);
+    }
+  }
+  return -1;
+}
+
+/* Unlinks a process from its level, clearing the level's bit if it empties.
+ */
+static void prio_unlink(Prio_data_s *prio, Op_process_s *process) {
+  Op_queue_s *queue = process->queue;
+  int level = process->prio_level;
+
+  op_queue_remove(queue, process);
+  if(queue != &prio->critical && queue->count == 0) {
+    prio->bitmap[level >> 6] &= ~(1ULL << (level & 63));
+  }
+}
+
+static int prio_create(Op_schedule_s *schedule) {
+  Prio_data_s *prio = calloc(1, sizeof(Prio_data_s));
+
+  if(prio == NULL) {
+    return -1;
+  }
+  op_queue_init(&prio->critical);
+  for(int i = 0; i <= MAX_PRIORITY; i++) {
+    op_queue_init(&prio->levels[i]);
+    prio->aging[i % MAX_AGE][i >> 6] |= 1ULL << (i & 63);
+  }
+  schedule->policy_data = prio;
+  return 0;
+}
+
+static int prio_add(Op_schedule_s *schedule, Op_process_s *process) {
+  Prio_data_s *prio = schedule->policy_data;
+
+  process->level = 0;
+  if((process->state & CRITICAL_FLAG) != 0) {
+    process->prio_level = MAX_PRIORITY;
+    op_queue_push(&prio->critical, process);
+    return 0;
+  }
+  prio_push(prio, schedule, process, process->priority);
+  return 0;
+}
+
+/* Back from the CPU, a process loses any levels it aged and rejoins its own priority.
+ */
+static int prio_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum) {
+  return prio_add(schedule, process);
+}
+
+static Op_process_s *prio_select(Op_schedule_s *schedule) {
+  Prio_data_s *prio = schedule->policy_data;
+  Op_process_s *process = op_queue_pop(&prio->critical);
+  int level = 0;
+
+  if(process != NULL) {
+    return process;
+  }
+  level = prio_highest(prio);
+  if(level < 0) {
+    return NULL;
+  }
+  process = prio->levels[level].head;
+  prio_unlink(prio, process);
+  return process;
+}
+
+/* Raises every process on this tick's non-empty levels that has waited MAX_AGE ticks.
+ * Each FIFO is oldest first, so a level stops at the first process that hasn't.
+ */
+static void prio_tick(Op_schedule_s *schedule) {
+  Prio_data_s *prio = schedule->policy_data;
+  Op_process_s *current = NULL;
+  int phase = schedule->tick % MAX_AGE;
+
+  for(int word = PRIO_WORDS - 1; word >= 0; word--) {
+    unsigned long long bits = prio->bitmap[word] & prio->aging[phase][word];
+    while(bits != 0) {
+      int bit = 63 - __builtin_clzll(bits);
+      int level = word * 64 + bit;
+      bits &= ~(1ULL << bit);
+      if(level == MAX_PRIORITY) {
+        continue;
+      }
+      while((current = prio->levels[level].head) != NULL && schedule->tick - current->age_tick >= MAX_AGE) {
+        prio_unlink(prio, current);
+        prio_push(prio, schedule, current, (level + PRIO_AGE_LEVELS < MAX_PRIORITY) ? level + PRIO_AGE_LEVELS : MAX_PRIORITY);
+        if(schedule->trace != NULL) {
+          schedule->trace(schedule->trace_arg, OP_EV_PROMOTE, current);
+        }
+      }
+    }
+  }
+}
+
+static void prio_exit(Op_schedule_s *schedule, Op_process_s *process) {
+}
+
+static void prio_terminate(Op_schedule_s *schedule, Op_process_s *process) {
+  prio_unlink(schedule->policy_data, process);
+}
+
+static int prio_quantum(Op_schedule_s *schedule, Op_process_s *process) {
+  return 1;
+}
+
+static void prio_walk(Op_schedule_s *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg) {
+  Prio_data_s *prio = schedule->policy_data;
+
+  for(Op_process_s *walker = prio->critical.head; walker != NULL; walker = walker->next) {
+    visit(arg, walker);
+  }
+  for(int level = MAX_PRIORITY; level >= MIN_PRIORITY; level--) {
+    for(Op_process_s *walker = prio->levels[level].head; walker != NULL; walker = walker->next) {
+      visit(arg, walker);
+    }
+  }
+}
+
+static void prio_destroy(Op_schedule_s *schedule) {
+  free(schedule->policy_data);
+  schedule->policy_data = NULL;
+}
+
+Op_policy_s op_policy_prio = {"prio", "One FIFO per priority (-p N), highest first via a bitmap, with aging",
+  prio_create, prio_add, prio_requeue, prio_select, prio_tick, prio_exit, prio_terminate, prio_quantum, prio_walk, prio_destroy};
+
+
+/* Stride (Waldspurger and Weihl): deterministic proportional share by tickets.
+ * - Each process advances its pass by its stride (STRIDE_ONE / tickets) every quantum it runs,
+ *   and the lowest pass runs next, so over any run CPU time divides in the ratio of tickets
+ *   (300 vs 100 tickets gets exactly 3x, off by at most one quantum).
+ * - global_pass follows the pass of each selected process.  Anyone joining (new, woken, stolen from
+ *   another CPU or moved from another policy) starts one stride past it: it can't bank credit
+ *   from time it wasn't competing, or inherit another schedule's virtual time.
+ */
+static int stride_before(Op_process_s *a, Op_process_s *b) {
+  return a->pass < b->pass;
+}
+
+static unsigned long long stride_of(Op_process_s *process) {
+  return STRIDE_ONE / (unsigned long long)process->tickets;
+}
+
+static int stride_create(Op_schedule_s *schedule) {
+  Stride_data_s *stride = malloc(sizeof(Stride_data_s));
+
+  if(stride == NULL) {
+    return -1;
+  }
+  if(op_heap_init(&stride->heap, stride_before) != 0) {
+    free(stride);
+    return -1;
+  }
+  stride->global_pass = 0;
+  stride->tickets = 0;
+  stride->rng = schedule->seed ^ OP_SEED_MIX; /* Same seed, same draws (xorshift64 never leaves 0) */
+  if(stride->rng == 0) {
+    stride->rng = OP_SEED_MIX;
+  }
+  schedule->policy_data = stride;
+  return 0;
+}
+
+static int stride_push(Stride_data_s *stride, Op_process_s *process) {
+  if(op_heap_push(&stride->heap, process) != 0) {
+    return -1;
+  }
+  stride->tickets += process->tickets;
+  return 0;
+}
+
+static int stride_add(Op_schedule_s *schedule, Op_process_s *process) {
+  Stride_data_s *stride = schedule->policy_data;
+
+  process->level = 0;
+  process->pass = stride->global_pass + stride_of(process);
+  return stride_push(stride, process);
+}
+
+/* Charges the quantum just run.  A process selected here left at global_pass, so this is the
+ *  same as pass += stride, and one stolen from another CPU is rebased onto this schedule's pass.
+ */
+static int stride_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum) {
+  return stride_add(schedule, process);
+}
+
+static Op_process_s *stride_select(Op_schedule_s *schedule) {
+  Stride_data_s *stride = schedule->policy_data;
+  Op_process_s *process = op_heap_pop(&stride->heap);
+
+  if(process == NULL) {
+    return NULL;
+  }
+  stride->tickets -= process->tickets;
+  if(process->pass > stride->global_pass) {
+    stride->global_pass = process->pass;
+  }
+  return process;
+}
+
+static void stride_tick(Op_schedule_s *schedule) {
+}
+
+static void stride_exit(Op_schedule_s *schedule, Op_process_s *process) {
+}
+
+static void stride_terminate(Op_schedule_s *schedule, Op_process_s *process) {
+  Stride_data_s *stride = schedule->policy_data;
+
+  op_heap_remove(&stride->heap, process);
+  stride->tickets -= process->tickets;
+}
+
+static int stride_quantum(Op_schedule_s *schedule, Op_process_s *process) {
+  return 1;
+}
+
+static void stride_walk(Op_schedule_s *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg) {
+  Stride_data_s *stride = schedule->policy_data;
+
+  for(int i = 0; i < stride->heap.count; i++) {
+    visit(arg, stride->heap.items[i]);
+  }
+}
+
+static void stride_destroy(Op_schedule_s *schedule) {
+  Stride_data_s *stride = schedule->policy_data;
+  free(stride->heap.items);
+  free(stride);
+  schedule->policy_data = NULL;
+}
+
+Op_policy_s op_policy_stride = {"stride", "Proportional share, CPU split by tickets (-t N), lowest pass runs next",
+  stride_create, stride_add, stride_requeue, stride_select, stride_tick, stride_exit, stride_terminate, stride_quantum, stride_walk, stride_destroy};
+
+
+/* Lottery: the randomized version of stride.  Each quantum draws one of the Ready processes'
+ *  tickets at random, so shares match the ticket ratio on average but can drift over short runs
+ *  (within about 1/sqrt(quanta)).  The draw walks the Ready set, O(n).
+ */
+static int lottery_add(Op_schedule_s *schedule, Op_process_s *process) {
+  Stride_data_s *lottery = schedule->policy_data;
+
+  process->level = 0;
+  process->pass = 0; // Every key equal, the heap is only used as a set with O(1) unlinking
+  return stride_push(lottery, process);
+}
+
+static int lottery_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum) {
+  return lottery_add(schedule, process);
+}
+
+static Op_process_s *lottery_select(Op_schedule_s *schedule) {
+  Stride_data_s *lottery = schedule->policy_data;
+  unsigned long long winner = 0;
+  Op_process_s *process = NULL;
+
+  if(lottery->heap.count == 0) {
+    return NULL;
+  }
+  lottery->rng ^= lottery->rng << 13;
+  lottery->rng ^= lottery->rng >> 7;
+  lottery->rng ^= lottery->rng << 17;
+  winner = lottery->rng % lottery->tickets;
+  for(int i = 0; i < lottery->heap.count; i++) {
+    process = lottery->heap.items[i];
+    if(winner < (unsigned long long)process->tickets) {
+      break;
+    }
+    winner -= process->tickets;
+  }
+  stride_terminate(schedule, process);
+  return process;
+}
+
+Op_policy_s op_policy_lottery = {"lottery", "Proportional share, each quantum drawn at random by tickets (-t N)",
+  stride_create, lottery_add, lottery_requeue, lottery_select, stride_tick, stride_exit, stride_terminate, stride_quantum, stride_walk, stride_destroy};
@@ -1,4 +1,4 @@
-/* 
+/*
  * Name: Justin Thomas
  */
 
@@ -11,6 +11,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <time.h>
 #include <pthread.h>
 #include <sched.h>
 // Local Includes
@@ -18,80 +19,788 @@
 #include "vm_support.h"
 #include "vm_process.h"
 
-#define CRITICAL_FLAG   (1 << 31) 
-#define LOW_FLAG        (1 << 30) 
-#define READY_FLAG      (1 << 29)
-#define DEFUNCT_FLAG    (1 << 28)
-#define MAX_AGE 5 
+#define MAX_AGE 5
+#define PID_INDEX_MIN_SIZE 64 // Starting slot count (power of 2)
+#define HEAP_MIN_SIZE 64 // Starting slot count of a heap
+#define POOL_SLAB_NODES 64 // Nodes carved out of each slab
+#define OP_TRACE(schedule, event, process) do { \
+  if((schedule)->trace != NULL) { (schedule)->trace((schedule)->trace_arg, (event), (process)); } \
+} while(0)
 
+// Slab of Scheduler nodes (only used with USE_NODE_POOL)
+typedef struct pool_slab {
+  struct pool_slab *next; // Every slab ever allocated, freed by op_pool_release
+  Op_process_s nodes[POOL_SLAB_NODES];
+} Op_pool_slab_s;
+
+// Node Pool Globals (shared by every schedule, guarded by pool_m)
+static pthread_mutex_t pool_m = PTHREAD_MUTEX_INITIALIZER;
+static Op_pool_slab_s *pool_slabs = NULL;
+static Op_process_s *pool_free = NULL; // Free-list linked through node->next
+static Op_pool_stats_s pool_stats = {0};
+
+
+/* Initializes an empty Op_queue_s (no nodes, head and tail both NULL).
+ */
+void op_queue_init(Op_queue_s *queue) {
+  queue->count = 0;
+  queue->head = NULL;
+  queue->tail = NULL;
+}
+
+/* Appends a process to the end of the queue in O(1) using the tail pointer.
+ */
+void op_queue_push(Op_queue_s *queue, Op_process_s *process) {
+  process->next = NULL;
+  process->prev = queue->tail;
+  process->queue = queue;
+
+  if(queue->tail == NULL) { /* Empty queue, new node is both head and tail */
+    queue->head = process;
+  } else {
+    queue->tail->next = process;
+  }
+
+  queue->tail = process;
+  queue->count++;
+}
+
+/* Removes the first process from the queue in O(1).
+ * Returns the process removed or NULL if the queue is empty.
+ */
+Op_process_s *op_queue_pop(Op_queue_s *queue) {
+  Op_process_s *current = queue->head;
+
+  if(current != NULL) {
+    op_queue_remove(queue, current);
+  }
+
+  return current;
+}
+
+/* Unlinks the given process from anywhere in the queue in O(1).
+ * Keeps the head/tail pointers and count consistent.
+ */
+void op_queue_remove(Op_queue_s *queue, Op_process_s *process) {
+  if(process->prev == NULL) {
+    queue->head = process->next;
+  } else {
+    process->prev->next = process->next;
+  }
+
+  if(process->next == NULL) { /* Removed the last node, tail moves back to prev */
+    queue->tail = process->prev;
+  } else {
+    process->next->prev = process->prev;
+  }
+
+  process->next = NULL;
+  process->prev = NULL;
+  process->queue = NULL;
+  queue->count--;
+}
+
+/* Sets up an empty heap ordered by before (ties leave in the order they were pushed).
+ * Returns a 0 on success or a -1 on any error.
+ */
+int op_heap_init(Op_heap_s *heap, int (*before)(Op_process_s *a, Op_process_s *b)) {
+  heap->items = malloc(HEAP_MIN_SIZE * sizeof(Op_process_s *));
+  if(heap->items == NULL) {
+    return -1;
+  }
+  heap->count = 0;
+  heap->size = HEAP_MIN_SIZE;
+  heap->seq = 0;
+  heap->before = before;
+  return 0;
+}
+
+/* Orders two processes by key, then by arrival for equal keys.
+ */
+static int heap_less(Op_heap_s *heap, Op_process_s *a, Op_process_s *b) {
+  if(heap->before(a, b)) {
+    return 1;
+  }
+  if(heap->before(b, a)) {
+    return 0;
+  }
+  return a->heap_seq < b->heap_seq;
+}
+
+static void heap_place(Op_heap_s *heap, Op_process_s *process, int slot) {
+  heap->items[slot] = process;
+  process->heap_index = slot;
+}
+
+/* Moves the process in slot up towards the root until its parent runs before it.
+ */
+static void heap_up(Op_heap_s *heap, int slot) {
+  Op_process_s *process = heap->items[slot];
+
+  while(slot > 0 && heap_less(heap, process, heap->items[(slot - 1) / 2])) {
+    heap_place(heap, heap->items[(slot - 1) / 2], slot);
+    slot = (slot - 1) / 2;
+  }
+  heap_place(heap, process, slot);
+}
+
+/* Moves the process in slot down until both children run after it.
+ */
+static void heap_down(Op_heap_s *heap, int slot) {
+  Op_process_s *process = heap->items[slot];
+  int child = 0;
+
+  while((child = slot * 2 + 1) < heap->count) {
+    if(child + 1 < heap->count && heap_less(heap, heap->items[child + 1], heap->items[child])) {
+      child++;
+    }
+    if(!heap_less(heap, heap->items[child], process)) {
+      break;
+    }
+    heap_place(heap, heap->items[child], slot);
+    slot = child;
+  }
+  heap_place(heap, process, slot);
+}
+
+/* Adds a process in O(log n), doubling the slots when full.
+ * Returns a 0 on success or a -1 on any error.
+ */
+int op_heap_push(Op_heap_s *heap, Op_process_s *process) {
+  if(heap->count == heap->size) {
+    Op_process_s **items = realloc(heap->items, heap->size * 2 * sizeof(Op_process_s *));
+    if(items == NULL) {
+      return -1;
+    }
+    heap->items = items;
+    heap->size *= 2;
+  }
+  process->heap_seq = heap->seq++;
+  heap_place(heap, process, heap->count++);
+  heap_up(heap, process->heap_index);
+  return 0;
+}
+
+/* Unlinks any process in the heap in O(log n).
+ */
+void op_heap_remove(Op_heap_s *heap, Op_process_s *process) {
+  int slot = process->heap_index;
+  Op_process_s *last = heap->items[--heap->count];
+
+  process->heap_index = -1;
+  if(last == process) {
+    return;
+  }
+  heap_place(heap, last, slot);
+  heap_up(heap, slot);
+  heap_down(heap, last->heap_index);
+}
+
+/* Unlinks and returns the process that runs first (NULL if the heap is empty).
+ */
+Op_process_s *op_heap_pop(Op_heap_s *heap) {
+  Op_process_s *first = NULL;
+
+  if(heap->count == 0) {
+    return NULL;
+  }
+  first = heap->items[0];
+  op_heap_remove(heap, first);
+  return first;
+}
+
+/* Deadline heap order: earliest absolute deadline first (EDF).
+ */
+static int op_deadline_before(Op_process_s *a, Op_process_s *b) {
+  return a->deadline_ns < b->deadline_ns;
+}
+
+/* Empties an inbox.  Each cell starts out ready for the first lap of the ring (seq == index).
+ */
+void op_inbox_init(Op_inbox_s *inbox) {
+  inbox->head = 0;
+  inbox->tail = 0;
+  for(unsigned long i = 0; i < OP_INBOX_SIZE; i++) {
+    inbox->cells[i].process = NULL;
+    __atomic_store_n(&inbox->cells[i].seq, i, __ATOMIC_RELAXED);
+  }
+}
+
+/* Hands a process to the inbox without taking any lock (safe from any number of threads).
+ * Producers claim a position with a CAS on head, then publish the cell by advancing its seq.
+ * Returns a 0 on success or a -1 if the inbox is full (or on any error).
+ */
+int op_inbox_push(Op_inbox_s *inbox, Op_process_s *process) {
+  Op_inbox_cell_s *cell = NULL;
+  unsigned long pos = 0;
+  long diff = 0;
+
+  if(inbox == NULL || process == NULL) {
+    return -1;
+  }
+
+  pos = __atomic_load_n(&inbox->head, __ATOMIC_RELAXED);
+  for(;;) {
+    cell = &inbox->cells[pos & (OP_INBOX_SIZE - 1)];
+    diff = (long)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (long)pos;
+    if(diff == 0) { /* Cell is free for this lap, try to claim it */
+      if(__atomic_compare_exchange_n(&inbox->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if(diff < 0) { /* Consumer hasn't freed it from the last lap, full */
+      return -1;
+    } else { /* Another producer got here first */
+      pos = __atomic_load_n(&inbox->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  cell->process = process;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/* Takes the oldest published process out of the inbox (single consumer only).
+ * Returns the process or NULL if nothing has been published yet.
+ */
+Op_process_s *op_inbox_pop(Op_inbox_s *inbox) {
+  Op_inbox_cell_s *cell = NULL;
+  Op_process_s *process = NULL;
+  unsigned long pos = 0;
+
+  if(inbox == NULL) {
+    return NULL;
+  }
+
+  pos = inbox->tail;
+  cell = &inbox->cells[pos & (OP_INBOX_SIZE - 1)];
+  if(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+    return NULL;
+  }
+
+  process = cell->process;
+  inbox->tail = pos + 1;
+  __atomic_store_n(&cell->seq, pos + OP_INBOX_SIZE, __ATOMIC_RELEASE); /* Free for the next lap */
+  return process;
+}
+
+/* Returns roughly how many processes are waiting in the inbox (exact when no push is in flight).
+ */
+int op_inbox_count(Op_inbox_s *inbox) {
+  long count = 0;
+
+  if(inbox == NULL) {
+    return 0;
+  }
+
+  count = (long)(__atomic_load_n(&inbox->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&inbox->tail, __ATOMIC_ACQUIRE));
+  return (count < 0) ? 0 : (int)count;
+}
+
+/* Moves up to max waiting processes from the inbox into the schedule with op_add.
+ * A max of 0 or less drains everything that has been published.
+ * Returns the number of processes added.
+ */
+int op_inbox_drain(Op_inbox_s *inbox, Op_schedule_s *schedule, int max) {
+  Op_process_s *process = NULL;
+  int added = 0;
+
+  if(inbox == NULL || schedule == NULL) {
+    return 0;
+  }
+
+  while((max <= 0 || added < max) && (process = op_inbox_pop(inbox)) != NULL) {
+    if(op_add(schedule, process) == 0) {
+      added++;
+    }
+  }
+
+  return added;
+}
+
+/* Hashes a pid into a slot of the index (Fibonacci hashing, size is a power of 2).
+ */
+static int pid_index_slot(Op_pid_index_s *index, pid_t pid) {
+  return (int)(((unsigned int)pid * 2654435761u) & (unsigned int)(index->size - 1));
+}
+
+/* Allocates a PID index with the given number of slots (power of 2).
+ * Returns the new index or NULL on any error.
+ */
+static Op_pid_index_s *pid_index_create(int size) {
+  Op_pid_index_s *index = malloc(sizeof(Op_pid_index_s));
+
+  if(index == NULL) {
+    return NULL;
+  }
+
+  index->slots = calloc(size, sizeof(Op_process_s *));
+  if(index->slots == NULL) {
+    free(index);
+    return NULL;
+  }
+
+  index->size = size;
+  index->count = 0;
+
+  return index;
+}
+
+/* Places a node into the first free slot of its probe sequence (no resizing).
+ */
+static void pid_index_place(Op_pid_index_s *index, Op_process_s *process) {
+  int slot = pid_index_slot(index, process->pid);
+
+  while(index->slots[slot] != NULL) {
+    slot = (slot + 1) & (index->size - 1);
+  }
+
+  index->slots[slot] = process;
+  index->count++;
+}
+
+/* Doubles the slot count and re-places every node.
+ * Returns a 0 on success or a -1 on any error (the index is left as it was).
+ */
+static int pid_index_grow(Op_pid_index_s *index) {
+  Op_process_s **old_slots = index->slots;
+  int old_size = index->size;
+  int i = 0;
+
+  index->slots = calloc(old_size * 2, sizeof(Op_process_s *));
+  if(index->slots == NULL) {
+    index->slots = old_slots;
+    return -1;
+  }
+
+  index->size = old_size * 2;
+  index->count = 0;
+
+  for(i = 0; i < old_size; i++) {
+    if(old_slots[i] != NULL) {
+      pid_index_place(index, old_slots[i]);
+    }
+  }
+
+  free(old_slots);
+  return 0;
+}
+
+/* Adds a node to the index, growing it to keep the load factor at or below 1/2.
+ * Returns a 0 on success or a -1 on any error.
+ */
+static int pid_index_insert(Op_pid_index_s *index, Op_process_s *process) {
+  if((index->count + 1) * 2 > index->size && pid_index_grow(index) != 0) {
+    return -1;
+  }
+
+  pid_index_place(index, process);
+  return 0;
+}
+
+/* Returns the slot holding pid or -1 if pid is not in the index.
+ */
+static int pid_index_lookup(Op_pid_index_s *index, pid_t pid) {
+  int slot = pid_index_slot(index, pid);
+
+  while(index->slots[slot] != NULL) {
+    if(index->slots[slot]->pid == pid) {
+      return slot;
+    }
+    slot = (slot + 1) & (index->size - 1);
+  }
+
+  return -1;
+}
+
+/* Removes a node from the index, shifting later probes back so no tombstones are needed.
+ */
+static void pid_index_remove(Op_pid_index_s *index, Op_process_s *process) {
+  int hole = pid_index_lookup(index, process->pid);
+  int slot = 0;
+  int home = 0;
+
+  if(hole < 0 || index->slots[hole] != process) {
+    return;
+  }
+
+  index->slots[hole] = NULL;
+  index->count--;
+
+  slot = (hole + 1) & (index->size - 1);
+  while(index->slots[slot] != NULL) {
+    home = pid_index_slot(index, index->slots[slot]->pid);
+
+    /* Move the entry into the hole if the hole lies between its home slot and where it sits */
+    if(((slot - home) & (index->size - 1)) >= ((slot - hole) & (index->size - 1))) {
+      index->slots[hole] = index->slots[slot];
+      index->slots[slot] = NULL;
+      hole = slot;
+    }
+
+    slot = (slot + 1) & (index->size - 1);
+  }
+}
+
+/* Takes one node from the pool free-list, carving a new slab when it runs dry.
+ * With USE_NODE_POOL set to 0 this is a plain malloc, so the two can be benchmarked.
+ * Returns the uninitialized node or NULL on any error.
+ */
+static Op_process_s *pool_alloc() {
+  Op_process_s *node = NULL;
+
+  pthread_mutex_lock(&pool_m);
+#if USE_NODE_POOL > 0
+  if(pool_free == NULL) {
+    Op_pool_slab_s *slab = malloc(sizeof(Op_pool_slab_s));
+    if(slab == NULL) {
+      pthread_mutex_unlock(&pool_m);
+      return NULL;
+    }
+    slab->next = pool_slabs;
+    pool_slabs = slab;
+    pool_stats.slabs++;
+
+    for(int i = POOL_SLAB_NODES - 1; i >= 0; i--) { /* Thread the new nodes onto the free-list in order */
+      slab->nodes[i].next = pool_free;
+      pool_free = &slab->nodes[i];
+    }
+    pool_stats.free += POOL_SLAB_NODES;
+  }
+
+  node = pool_free;
+  pool_free = node->next;
+  pool_stats.free--;
+#else
+  node = malloc(sizeof(Op_process_s));
+  if(node == NULL) {
+    pthread_mutex_unlock(&pool_m);
+    return NULL;
+  }
+#endif
+  pool_stats.live++;
+  if(pool_stats.live > pool_stats.peak) {
+    pool_stats.peak = pool_stats.live;
+  }
+  pthread_mutex_unlock(&pool_m);
+
+  return node;
+}
+
+/* Returns a node taken with op_new_process to the pool (or to the heap without USE_NODE_POOL).
+ */
+void op_free_process(Op_process_s *process) {
+  if(process == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool_m);
+#if USE_NODE_POOL > 0
+  process->next = pool_free;
+  pool_free = process;
+  pool_stats.free++;
+#else
+  free(process);
+#endif
+  pool_stats.live--;
+  pthread_mutex_unlock(&pool_m);
+}
+
+/* Copies the current node pool counters into stats.
+ */
+void op_pool_stats(Op_pool_stats_s *stats) {
+  if(stats == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool_m);
+  *stats = pool_stats;
+  pthread_mutex_unlock(&pool_m);
+}
+
+/* Gives every slab back to the heap.
+ * Only call this once every node has been freed (eg. at shutdown).
+ */
+void op_pool_release() {
+  Op_pool_slab_s *slab = NULL;
+
+  pthread_mutex_lock(&pool_m);
+  while(pool_slabs != NULL) {
+    slab = pool_slabs;
+    pool_slabs = slab->next;
+    free(slab);
+  }
+  pool_free = NULL;
+  pool_stats.free = 0;
+  pool_stats.slabs = 0;
+  pthread_mutex_unlock(&pool_m);
+}
+
+/* Returns CLOCK_MONOTONIC in nanoseconds, the clock every Op_process_s timestamp uses.
+ */
+unsigned long long op_now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
 
 /* Initializes the Op_schedule_s Struct and all of the Op_queue_s Structs
  * Follow the project documentation for this function.
  * Returns a pointer to the new Op_schedule_s or NULL on any error.
  */
 Op_schedule_s *op_create() {
- 
-  Op_schedule_s *new = malloc(sizeof(Op_schedule_s));
-  
-  new->ready_queue_high = malloc(sizeof(Op_queue_s));
-  new->ready_queue_low = malloc(sizeof(Op_queue_s));
-  new->defunct_queue = malloc(sizeof(Op_queue_s));
-
-  new->ready_queue_high->head = NULL;
-  new->ready_queue_low->head = NULL;
-  new->defunct_queue->head = NULL;
 
-  new->ready_queue_high->count = 0;
-  new->ready_queue_low->count = 0;
-  new->defunct_queue->count = 0;
+  Op_schedule_s *new = calloc(1, sizeof(Op_schedule_s));
+  int i = 0;
+  int failed = 0;
 
   if(new == NULL) {
     return NULL;
   }
 
-  return new; // Replace This Line with Your Code!
+  new->ready_queue_critical = malloc(sizeof(Op_queue_s));
+  new->defunct_queue = malloc(sizeof(Op_queue_s));
+  new->parked_queue = malloc(sizeof(Op_queue_s));
+  new->pid_index = pid_index_create(PID_INDEX_MIN_SIZE);
+  failed = (new->ready_queue_critical == NULL || new->defunct_queue == NULL || new->parked_queue == NULL || new->pid_index == NULL);
+  if(op_heap_init(&new->deadline_heap, op_deadline_before) != 0) {
+    failed = 1;
+  }
+
+  for(i = 0; i < OP_MAX_LEVELS; i++) {
+    new->ready_queues[i] = malloc(sizeof(Op_queue_s));
+    if(new->ready_queues[i] == NULL) {
+      failed = 1;
+    } else {
+      op_queue_init(new->ready_queues[i]);
+    }
+  }
+
+  if(failed) {
+    free(new->deadline_heap.items);
+    free(new->ready_queue_critical);
+    free(new->defunct_queue);
+    free(new->parked_queue);
+    if(new->pid_index != NULL) {
+      free(new->pid_index->slots);
+      free(new->pid_index);
+    }
+    for(i = 0; i < OP_MAX_LEVELS; i++) {
+      free(new->ready_queues[i]);
+    }
+    free(new);
+    return NULL;
+  }
+
+  op_queue_init(new->ready_queue_critical);
+  op_queue_init(new->defunct_queue);
+  op_queue_init(new->parked_queue);
+  new->tick = 0;
+
+  op_mlfq_classic(&new->mlfq); /* Start as the classic High/Low schedule */
+  new->ready_queue_high = new->ready_queues[0];
+  new->ready_queue_low = new->ready_queues[new->mlfq.levels - 1];
+  new->policy = op_policies[0];
+  new->policy->create(new); /* The MLFQ policy keeps its state in the queues above, this can't fail */
+
+  return new;
+}
+
+/* Fills config with the classic two level High/Low settings.
+ */
+void op_mlfq_classic(Op_mlfq_s *config) {
+  memset(config, 0, sizeof(Op_mlfq_s));
+  config->levels = 2;
+  config->quantum[0] = 1;
+  config->quantum[1] = 2; /* Low priority runs twice as long */
+  config->demote = 0;
+  config->boost_ticks = 0;
 }
 
 /* Create a new Op_process_s with the given information.
- * - Malloc and copy the command string, don't just assign it!
+ * - The node comes from the node pool and the command is copied inline into it.
  * Follow the project documentation for this function.
  * Returns the Op_process_s on success or a NULL on any error.
  */
 Op_process_s *op_new_process(char *command, pid_t pid, int is_low, int is_critical) {
 
-  int mask; /* mask variable that's free to use */
-  Op_process_s *newProcess = malloc(sizeof(Op_process_s));
+  Op_process_s *newProcess = pool_alloc();
 
-  newProcess->state &= ~(DEFUNCT_FLAG); /* set defunct to 0 by clearing it with AND operation + complement */
-  newProcess->state |= (READY_FLAG); /* set ready to 1 by OR operation and shifting */
+  if(newProcess == NULL) {
+    return NULL;
+  }
 
-  if(is_low == 0) { /* if is_low is false (0) then change bit 30 to 0 and everything else to the same */
-    newProcess->state &= ~(LOW_FLAG);
-  } else {
+  newProcess->state = READY_FLAG; /* ready to 1, defunct to 0 and the exit code bits all 0 */
+
+  if(is_low != 0) { /* if is_low is true then set bit 30 */
     newProcess->state |= (LOW_FLAG);
   }
 
-  if(is_critical == 0) { /* if is_critical is false (0) then change bit 31 to 0 and everything else to the same */
-    newProcess->state &= ~(CRITICAL_FLAG);
-  } else {
+  if(is_critical != 0) { /* if is_critical is true then set bit 31 */
     newProcess->state |= (CRITICAL_FLAG);
   }
 
-  mask = 0xf0000000; /* have a mask with 1111 for bit 28+29+30+31 */
-
-  newProcess->state &= mask; /* use the mask to keep the current bits from 28-31 the same and make the rest all 0*/
-
-  newProcess->age = 0;
+  newProcess->age_tick = 0;
+  newProcess->level = 0;
+  newProcess->last_core = -1;
+  newProcess->migrations = 0;
+  newProcess->pinned = 0;
+  newProcess->quanta = 0;
+  newProcess->submit_ns = op_now_ns();
+  newProcess->ready_ns = newProcess->submit_ns;
+  newProcess->first_run_ns = 0;
+  newProcess->exit_ns = 0;
+  newProcess->wait_ns = 0;
+  newProcess->low_wait_ns = 0;
+  newProcess->cpu_ns = 0;
+  newProcess->stop_ns = 0;
+  newProcess->priority = DEFAULT_PRIORITY;
+  newProcess->vruntime = 0;
+  newProcess->charged_ns = 0;
+  newProcess->heap_index = -1;
+  newProcess->heap_seq = 0;
+  newProcess->prio_level = DEFAULT_PRIORITY;
+  newProcess->deadline_ns = 0;
+  newProcess->relative_ns = 0;
+  newProcess->runtime_ns = 0;
+  newProcess->edf = 0;
+  newProcess->tickets = DEFAULT_TICKETS;
+  newProcess->pass = 0;
+  newProcess->busy_permille = 0;
+  newProcess->bound = OP_BOUND_UNKNOWN;
+  newProcess->recheck_ns = 0;
+  newProcess->parks = 0;
 
   newProcess->pid = pid;
 
-  newProcess->cmd = malloc(MAX_CMD * sizeof(char));
-
   strncpy(newProcess->cmd, command, MAX_CMD * ( sizeof(char)));
+  newProcess->cmd[MAX_CMD - 1] = '\0';
 
   newProcess->next = NULL;
+  newProcess->prev = NULL;
+  newProcess->queue = NULL;
+
+  return newProcess;
+}
+
+/* Sets the priority a process is weighted by (MIN_PRIORITY to MAX_PRIORITY, DEFAULT_PRIORITY by default).
+ * Set it before the process is added, policies read it as it joins them.
+ * Returns a 0 on success or a -1 on any error (out of range).
+ */
+int op_set_priority(Op_process_s *process, int priority) {
+  if(process == NULL || priority < MIN_PRIORITY || priority > MAX_PRIORITY) {
+    return -1;
+  }
+
+  process->priority = priority;
+  return 0;
+}
+
+/* Sets how many tickets a process holds (MIN_TICKETS to MAX_TICKETS, DEFAULT_TICKETS by default).
+ * Under stride and lottery scheduling its share of the CPU is its tickets over everyone's.
+ * Returns a 0 on success or a -1 on any error (out of range).
+ */
+int op_set_tickets(Op_process_s *process, int tickets) {
+  if(process == NULL || tickets < MIN_TICKETS || tickets > MAX_TICKETS) {
+    return -1;
+  }
 
-  return newProcess; // Replace This Line with Your Code!
+  process->tickets = tickets;
+  return 0;
+}
+
+/* Makes a process a deadline job: it must finish relative_ns after it was submitted
+ *  and expects to need runtime_ns of CPU to do it.  Deadline jobs run ahead of every policy,
+ *  earliest deadline first.  Set it before the process is added.
+ * Returns a 0 on success or a -1 on any error (runtime longer than the deadline).
+ */
+int op_set_deadline(Op_process_s *process, unsigned long long relative_ns, unsigned long long runtime_ns) {
+  if(process == NULL || relative_ns == 0 || runtime_ns == 0 || runtime_ns > relative_ns) {
+    return -1;
+  }
+
+  process->relative_ns = relative_ns;
+  process->runtime_ns = runtime_ns;
+  process->deadline_ns = process->submit_ns + relative_ns;
+  process->edf = 1;
+  return 0;
+}
+
+/* Appends a process to the given Ready level.
+ * Critical processes on level 0 get their own FIFO so selection never has to scan for them.
+ * Processes joining the lowest level start aging now.
+ */
+static void op_push_level(Op_schedule_s *schedule, Op_process_s *process, int level) {
+  process->level = level;
+
+  if(level == 0 && (process->state & CRITICAL_FLAG) != 0) {
+    op_queue_push(schedule->ready_queue_critical, process);
+    return;
+  }
+
+  if(level == schedule->mlfq.levels - 1) {
+    process->age_tick = schedule->tick;
+  }
+
+  op_queue_push(schedule->ready_queues[level], process);
+}
+
+/* Charges a process for the time it has sat on the lowest level (it is leaving it, now is op_now_ns).
+ */
+static void op_leave_low(Op_schedule_s *schedule, Op_process_s *process, unsigned long long now) {
+  if(process->level == schedule->mlfq.levels - 1 && now > process->ready_ns) {
+    process->low_wait_ns += now - process->ready_ns;
+  }
+}
+
+/* Takes a process that was just unlinked from a Ready Queue out of the PID index,
+ *  and charges it for the time it waited since op_add/op_requeue.
+ */
+static void op_leave_ready(Op_schedule_s *schedule, Op_process_s *process) {
+  unsigned long long now = op_now_ns();
+
+  pid_index_remove(schedule->pid_index, process);
+  op_leave_low(schedule, process, now);
+  if(now > process->ready_ns) {
+    process->wait_ns += now - process->ready_ns;
+  }
+}
+
+/* Appends a process to the High Priority tier (level 0).
+ */
+static void op_push_high(Op_schedule_s *schedule, Op_process_s *process) {
+  op_push_level(schedule, process, 0);
+}
+
+/* Queues a process that just joined the Ready set: deadline jobs go into the EDF heap,
+ *  everything else is handed to the policy (requeue is 1 for a process back from the CPU).
+ * A deadline job still running past its deadline joins the policy from then on, so an
+ *  overrunning job can't hold the CPUs ahead of everyone else.
+ * Returns a 0 on success or a -1 on any error.
+ */
+static int op_enqueue(Op_schedule_s *schedule, Op_process_s *process, int requeue, int used_quantum) {
+  if(process->edf && process->ready_ns > process->deadline_ns) {
+    process->edf = 0;
+    requeue = 0; /* New to the policy */
+  }
+  if(process->edf) {
+    process->level = 0;
+    return op_heap_push(&schedule->deadline_heap, process);
+  }
+  if(requeue) {
+    return schedule->policy->requeue(schedule, process, used_quantum);
+  }
+  return schedule->policy->add(schedule, process);
+}
+
+/* Unlinks a queued process from wherever it waits (the EDF heap or the policy).
+ */
+static void op_unqueue(Op_schedule_s *schedule, Op_process_s *process) {
+  if(process->edf) {
+    op_heap_remove(&schedule->deadline_heap, process);
+  } else {
+    schedule->policy->terminate(schedule, process);
+  }
 }
 
 /* Adds a process into the appropriate singly linked list queue.
@@ -99,71 +808,162 @@ Op_process_s *op_new_process(char *command, pid_t pid, int is_low, int is_critic
  * Returns a 0 on success or a -1 on any error.
  */
 int op_add(Op_schedule_s *schedule, Op_process_s *process) {
-  
-  if(schedule == NULL) {
+
+  if(schedule == NULL || process == NULL) {
     return -1;
   }
 
-  Op_process_s *current; /* Node to use to iterate from head */
+  if(pid_index_insert(schedule->pid_index, process) != 0) {
+    return -1;
+  }
 
-  process->state |= READY_FLAG; 
+  process->state |= READY_FLAG;
   process->state &= ~(DEFUNCT_FLAG);
+  process->ready_ns = op_now_ns();
 
-  if((LOW_FLAG & process->state) == LOW_FLAG) { /* Insert a node at ready queue low*/
-    
-    if(schedule->ready_queue_low->head == NULL) {
-      
-      schedule->ready_queue_low->head = process;
-      schedule->ready_queue_low->head->next = NULL;
-      schedule->ready_queue_low->count++;
+  if(op_enqueue(schedule, process, 0, 0) != 0) {
+    pid_index_remove(schedule->pid_index, process);
+    return -1;
+  }
+  OP_TRACE(schedule, OP_EV_ADD, process);
 
-      return 0;
+  return 0;
+}
 
-    } else {
-      
-      current = schedule->ready_queue_low->head;
-      
-      while(current->next != NULL) {
-        current = current->next;
-      }
+/* Returns a process to the schedule after it ran for a quantum.
+ * used_quantum is 1 if it was still running when preempted (the policy may demote it).
+ * Returns a 0 on success or a -1 on any error.
+ */
+int op_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum) {
 
-      current->next = process;
-      current->next->next = NULL;
-      schedule->ready_queue_low->count++;
+  if(schedule == NULL || process == NULL) {
+    return -1;
+  }
 
-      return 0;
-    }
+  if(pid_index_insert(schedule->pid_index, process) != 0) {
+    return -1;
+  }
+
+  process->state |= READY_FLAG;
+  process->state &= ~(DEFUNCT_FLAG);
+  process->ready_ns = op_now_ns();
 
+  if(op_enqueue(schedule, process, 1, used_quantum) != 0) {
+    pid_index_remove(schedule->pid_index, process);
+    return -1;
   }
+  OP_TRACE(schedule, OP_EV_ADD, process);
+  return 0;
+}
 
-  if((LOW_FLAG & process->state) == 0) { /* Insert a node at ready queue high */
+/* Returns the quantum multiplier the policy gives a selected process.
+ * Returns 1 on any errors.
+ */
+int op_get_quantum(Op_schedule_s *schedule, Op_process_s *process) {
+
+  if(schedule == NULL || process == NULL) {
+    return 1;
+  }
+
+  if(process->edf) {
+    return 1;
+  }
+
+  return schedule->policy->quantum(schedule, process);
+}
+
+/* Records one slice: the process was on the CPU for wall_ns and used used_ns of CPU time in it.
+ * busy_permille averages the slices (each new one weighs 1/4), the first slice sets it outright.
+ * The class only flips once the average crosses ADAPT_IO_PERMILLE or ADAPT_CPU_PERMILLE,
+ *  so a job that sits in between doesn't bounce between quanta.
+ */
+void op_observe(Op_process_s *process, unsigned long long wall_ns, unsigned long long used_ns) {
+  unsigned int sample = 0;
+
+  if(process == NULL || wall_ns == 0) {
+    return;
+  }
+
+  sample = (used_ns >= wall_ns) ? 1000 : (unsigned int)(used_ns * 1000 / wall_ns);
+  if(process->bound == OP_BOUND_UNKNOWN) {
+    process->busy_permille = sample;
+  }
+  else {
+    process->busy_permille = (process->busy_permille * 3 + sample) / 4;
+  }
+
+  if(process->busy_permille <= ADAPT_IO_PERMILLE) {
+    process->bound = OP_BOUND_IO;
+  }
+  else if(process->busy_permille >= ADAPT_CPU_PERMILLE) {
+    process->bound = OP_BOUND_CPU;
+  }
+  else if(process->bound == OP_BOUND_UNKNOWN) {
+    process->bound = OP_BOUND_MIXED; /* Mixed from the start, keep the plain quantum until it settles */
+  }
+}
+
+/* Returns usec scaled for how the process behaves: I/O-bound jobs get ADAPT_IO_PERCENT of it
+ *  (they'd sleep through the rest), CPU-bound ones ADAPT_CPU_PERCENT (fewer switches).
+ * Unclassified and mixed processes and deadline jobs (their runtime is already budgeted) keep usec, and so
+ *  does everyone under stride and lottery: they share by counting quanta, which only holds if
+ *  every quantum is the same length.
+ */
+long op_adapt_quantum(Op_schedule_s *schedule, Op_process_s *process, long usec) {
+  long scaled = usec;
 
-    if(schedule->ready_queue_high->head == NULL) {
+  if(schedule == NULL || process == NULL || process->edf) {
+    return usec;
+  }
 
-      schedule->ready_queue_high->head = process;
-      schedule->ready_queue_high->head->next = NULL;
-      schedule->ready_queue_high->count++;
-      return 0;
+  if(schedule->policy == &op_policy_stride || schedule->policy == &op_policy_lottery) {
+    return usec;
+  }
 
-    } else {
+  if(process->bound == OP_BOUND_IO) {
+    scaled = usec * ADAPT_IO_PERCENT / 100;
+  }
+  else if(process->bound == OP_BOUND_CPU) {
+    scaled = usec * ADAPT_CPU_PERCENT / 100;
+  }
+  return (scaled > 0) ? scaled : 1;
+}
 
-      current = schedule->ready_queue_high->head;
+/* Switches the schedule to new level settings, keeping every queued process.
+ * Processes on levels that no longer exist move (in order) to the new lowest level.
+ * Returns a 0 on success or a -1 on any error (the schedule is unchanged).
+ */
+int op_set_mlfq(Op_schedule_s *schedule, Op_mlfq_s *config) {
+  Op_process_s *current = NULL;
+  int i = 0;
 
-      while (current->next != NULL) {
-        current = current->next;
-      }
-      
-      current->next = process;
-      current->next->next = NULL;
-      schedule->ready_queue_high->count++;
+  if(schedule == NULL || config == NULL) {
+    return -1;
+  }
 
-      return 0;
+  if(config->levels < 2 || config->levels > OP_MAX_LEVELS || config->boost_ticks < 0) {
+    return -1;
+  }
 
+  for(i = 0; i < config->levels; i++) {
+    if(config->quantum[i] < 1) {
+      return -1;
     }
+  }
 
+  for(i = config->levels; i < schedule->mlfq.levels; i++) {
+    while((current = op_queue_pop(schedule->ready_queues[i])) != NULL) {
+      current->level = config->levels - 1;
+      current->age_tick = schedule->tick;
+      op_queue_push(schedule->ready_queues[config->levels - 1], current);
+    }
   }
 
-  return -1;
+  schedule->mlfq = *config;
+  schedule->ready_queue_low = schedule->ready_queues[config->levels - 1];
+
+  return 0;
+}
 
 /* Returns the number of items in a given Op_queue_s
  * Follow the project documentation for this function.
@@ -175,205 +975,197 @@ int op_get_count(Op_queue_s *queue) {
     return -1;
   }
 
-  return queue->count; // Replace This Line with Your Code!
+  return queue->count;
+}
+
+/* Returns how many processes are waiting in all of the Ready Queues combined.
+ * Every ready process is in the PID index, so this is O(1).
+ * Returns -1 on any errors.
+ */
+int op_get_ready_count(Op_schedule_s *schedule) {
+
+  if(schedule == NULL) {
+    return -1;
+  }
+
+  return schedule->pid_index->count;
+}
+
+/* Looks up a process waiting in either Ready Queue by its pid in O(1).
+ * Returns the process or NULL if it is not in a Ready Queue (or on any errors).
+ */
+Op_process_s *op_find(Op_schedule_s *schedule, pid_t pid) {
+  int slot = 0;
+
+  if(schedule == NULL) {
+    return NULL;
+  }
+
+  slot = pid_index_lookup(schedule->pid_index, pid);
+  if(slot < 0) {
+    return NULL;
+  }
+
+  return schedule->pid_index->slots[slot];
 }
 
 /* Selects the next process to run from the High Ready Queue.
+ * The first Critical process wins, otherwise the head of the High Queue, both in O(1).
  * Follow the project documentation for this function.
  * Returns the process selected or NULL if none available or on any errors.
  */
 Op_process_s *op_select_high(Op_schedule_s *schedule) {
-  
 
   Op_process_s *current;
-  Op_process_s *prev;
 
   if(schedule == NULL) {  /* Error Check */
     return NULL;
   }
-  
-  if (schedule->ready_queue_high->head == NULL) { /* Check If No processes available */
-    return NULL;
-  }
-  
-  current = schedule->ready_queue_high->head;
-
-  if((current->state & CRITICAL_FLAG) != 0) { /* Check Head First */
-    schedule->ready_queue_high->head = current->next;
-    
-    current->age = 0;
-    current->next = NULL;
 
-    schedule->ready_queue_high->count--;
+  current = op_queue_pop(schedule->ready_queue_critical); /* Critical processes first */
 
-    return current;
-    
+  if(current == NULL) { /* Remove first process if none are critical */
+    current = op_queue_pop(schedule->ready_queue_high);
   }
 
-  prev =  current;
-  current = current->next;
+  if(current == NULL) { /* Check If No processes available */
+    return NULL;
+  }
 
-  while(current != NULL) { /* Iterate through list to find critical flag */
-    
-    if((current->state & CRITICAL_FLAG) != 0) {
-      
-      prev->next = current->next;
-      
-      current->age = 0;
-      current->next = NULL;
+  op_leave_ready(schedule, current);
+  OP_TRACE(schedule, OP_EV_SELECT, current);
 
-      schedule->ready_queue_high->count--;
+  return current;
+}
 
-      return current;
-    }
+/* Schedule the next process to run from the Low Ready Queue.
+ * Follow the project documentation for this function.
+ * Returns the process selected or NULL if none available or on any errors.
+ */
+Op_process_s *op_select_low(Op_schedule_s *schedule) {
 
-    prev =  current;
-    current = current->next;
+  Op_process_s *current;
 
+  if(schedule == NULL) { /* Error Check */
+    return NULL;
   }
 
+  current = op_queue_pop(schedule->ready_queue_low);
+
+  if(current == NULL) { /* No processes available */
+    return NULL;
+  }
 
-  current = schedule->ready_queue_high->head; /* Remove first process that isn't critical */
-  schedule->ready_queue_high->head = current->next;
-  current->age = 0;
-  current->next = NULL;
-  
+  op_leave_ready(schedule, current);
+  OP_TRACE(schedule, OP_EV_SELECT, current);
 
-  return current; // Replace This Line with Your Code!
+  return current;
 }
 
-/* Schedule the next process to run from the Low Ready Queue.
- * Follow the project documentation for this function.
+/* Selects the next process to run, as ordered by the schedule's policy.
  * Returns the process selected or NULL if none available or on any errors.
  */
-Op_process_s *op_select_low(Op_schedule_s *schedule) {
-  
+Op_process_s *op_select(Op_schedule_s *schedule) {
+
   Op_process_s *current;
 
-  if(schedule == NULL) { /* Error Check */
+  if(schedule == NULL) {
     return NULL;
   }
-  
-  if (schedule->ready_queue_low->head == NULL) { /* Error Check */
+
+  current = op_heap_pop(&schedule->deadline_heap); /* Deadline jobs first, earliest deadline first */
+
+  if(current == NULL) {
+    current = schedule->policy->select(schedule);
+  }
+
+  if(current == NULL) {
     return NULL;
   }
-  
-  current = schedule->ready_queue_low->head;
-  schedule->ready_queue_high->head = current->next;
-  current->age = 0;
-  current->next = NULL;
 
-   
+  op_leave_ready(schedule, current);
+  OP_TRACE(schedule, OP_EV_SELECT, current);
 
   return current;
 }
 
-/* Add age to all processes in the Ready - Low Priority Queue, then
- *  promote all processes that are >= MAX_AGE.
+/* Advances the schedule one tick and lets the policy age its processes.
  * Follow the project documentation for this function.
  * Returns a 0 on success or -1 on any errors.
  */
 int op_promote_processes(Op_schedule_s *schedule) {
-  Op_process_s *current;
-  Op_process_s *iterator; /* Use a second iterating node to preserve the current pointer */
-  Op_process_s *prev;
 
   if (schedule == NULL) { /* Error Check */
     return -1;
   }
 
-  if (schedule->ready_queue_low->head == NULL) { /* Empty queue check */
-    return 0;
-  }
+  schedule->tick++;
+  schedule->policy->tick(schedule);
 
-   current = schedule->ready_queue_low->head;
+  return 0;
+}
 
-    while (current != NULL) {
-      current->age++;
-      current = current->next;
+/* MLFQ aging: add age to all processes in the Ready - Low Priority Queue, then
+ *  promote all processes that are >= MAX_AGE.
+ * Aging is lazy: one schedule tick ages every node at once, and a node's age is
+ *  the ticks since it joined the (FIFO) low queue.  The oldest nodes are always at
+ *  the head, so only the heads that actually expire are touched.
+ * With an MLFQ boost interval set, every boost_ticks ticks all levels move to level 0 instead.
+ */
+static void mlfq_tick(Op_schedule_s *schedule) {
+  Op_process_s *current;
+  int i = 0;
+
+  if(schedule->mlfq.boost_ticks > 0) { /* Periodic Boost, lower levels join level 0 in order */
+    if(schedule->tick % schedule->mlfq.boost_ticks == 0) {
+      unsigned long long now = op_now_ns();
+      for(i = 1; i < schedule->mlfq.levels; i++) {
+        while((current = op_queue_pop(schedule->ready_queues[i])) != NULL) {
+          op_leave_low(schedule, current, now);
+          op_push_high(schedule, current);
+          OP_TRACE(schedule, OP_EV_PROMOTE, current);
+        }
+      }
     }
+    return;
+  }
 
+  while((current = schedule->ready_queue_low->head) != NULL) { /* Move every head at MAX_AGE to the end of the high queue */
 
- while(schedule->ready_queue_low->head != NULL) {/* Loop to continuosly check the low priority head until it cannot be removed*/
-    
-    current = schedule->ready_queue_low->head; 
-
-    if (current->age < MAX_AGE) {
+    if (op_get_age(schedule, current) < MAX_AGE) {
       break;
     }
 
-    if (current->age >= MAX_AGE) {
-      schedule->ready_queue_low->head = current->next;
-
-      current->age = 0;
-      current->next = NULL;
-      schedule->ready_queue_low->count--;
-
-      if(schedule->ready_queue_high->head == NULL) {/* Check if High queue is NULL*/
-        schedule->ready_queue_high->head = current;
-        schedule->ready_queue_high->count++;
-        continue;   
-      }
-
-      iterator = schedule->ready_queue_high->head;
+    op_queue_remove(schedule->ready_queue_low, current);
+    op_leave_low(schedule, current, op_now_ns());
+    op_push_high(schedule, current);
+    OP_TRACE(schedule, OP_EV_PROMOTE, current);
+  }
+}
 
-      while(iterator->next != NULL) {
-        iterator = iterator->next;
-      }
+/* Returns how many ticks a process has waited in the Ready - Low Priority Queue.
+ * Returns 0 for a process that isn't waiting there or -1 on any errors.
+ */
+int op_get_age(Op_schedule_s *schedule, Op_process_s *process) {
 
-      iterator->next = current;
-      schedule->ready_queue_high->count++;
-    }
-  }
-  
-  if(schedule->ready_queue_low->head == NULL) {
-    return 0;
+  if(schedule == NULL || process == NULL) {
+    return -1;
   }
 
-  if(schedule->ready_queue_low->head->next == NULL) {
+  if(process->queue != schedule->ready_queue_low) {
     return 0;
   }
-  
-  do{/* Loop through low priority queue and insert*/
-    
-    current = schedule->ready_queue_low->head->next;
-    prev = schedule->ready_queue_low->head;
-
-    if (current->age >= MAX_AGE) {
-      prev->next = current->next;
-      current->age = 0;
-      current->next = NULL;
-      schedule->ready_queue_low->count--;
-
-      if(schedule->ready_queue_high->head == NULL) {
-        schedule->ready_queue_high->head = current;
-        schedule->ready_queue_high->count++;
-        continue;   
-      }
-      
-      iterator = schedule->ready_queue_high->head;
-
-      while(iterator->next != NULL) {
-        iterator = iterator->next;
-      }
 
-      iterator->next = current;
-    }
-
-  }while (current != NULL);
-
-  return 0;
+  return (int)(schedule->tick - process->age_tick);
 }
 
 /* This is called when a process exits normally.
- * Put the given node into the Defunct Queue and set the Exit Code 
+ * Put the given node into the Defunct Queue and set the Exit Code
  * Follow the project documentation for this function.
  * Returns a 0 on success or a -1 on any error.
- */ 
+ */
 int op_exited(Op_schedule_s *schedule, Op_process_s *process, int exit_code) {
 
-  Op_process_s *current;
-
   if(schedule == NULL) {
     return -1;
   }
@@ -382,26 +1174,26 @@ int op_exited(Op_schedule_s *schedule, Op_process_s *process, int exit_code) {
     return -1;
   }
 
+  if(op_find(schedule, process->pid) == process) { /* Still waiting in a Ready Queue, unlink it first */
+    op_unqueue(schedule, process);
+    op_leave_ready(schedule, process);
+  } else if(process->queue == schedule->parked_queue) { /* Parked, out of the Ready set */
+    op_queue_remove(schedule->parked_queue, process);
+    if(!process->edf) {
+      schedule->policy->exit(schedule, process);
+    }
+  } else if(!process->edf) {
+    schedule->policy->exit(schedule, process);
+  }
+  process->exit_ns = op_now_ns();
+
   process->state = process->state | DEFUNCT_FLAG;
   process->state = process->state & ~(READY_FLAG);
 
   process->state = process->state | exit_code;
 
-  if(schedule->defunct_queue->head == NULL) {
-    schedule->defunct_queue->head = process;
-    schedule->defunct_queue->count++;
-    return 0;
-  }
-
-  current = schedule->defunct_queue->head;
-
-  while(current->next != NULL) {
-    current = current->next;
-  }
-
-  current->next = process;
-  current->next->next = NULL;
-  schedule->defunct_queue->count++;
+  op_queue_push(schedule->defunct_queue, process);
+  OP_TRACE(schedule, OP_EV_EXIT, process);
 
   return 0;
 
@@ -415,222 +1207,381 @@ int op_exited(Op_schedule_s *schedule, Op_process_s *process, int exit_code) {
 int op_terminated(Op_schedule_s *schedule, pid_t pid, int exit_code) {
 
   Op_process_s *current;
-  Op_process_s *iterator;
-  Op_process_s *prev;
-  
+
   if(schedule == NULL) {
     return -1;
   }
 
-  if(schedule->ready_queue_high->head && schedule->ready_queue_low->head == NULL) {
+  current = op_find(schedule, pid); /* Any Ready Queue, via the PID index */
+
+  if(current != NULL) {
+    op_unqueue(schedule, current);
+    op_leave_ready(schedule, current);
+  } else {
+    /* Not Ready, it may be parked (a short list, walked in order) */
+    current = schedule->parked_queue->head;
+    while(current != NULL && current->pid != pid) {
+      current = current->next;
+    }
+    if(current == NULL) {
+      return -1;
+    }
+    op_queue_remove(schedule->parked_queue, current);
+    if(!current->edf) {
+      schedule->policy->exit(schedule, current);
+    }
+  }
+  current->exit_ns = op_now_ns();
+
+  current->state = current->state | DEFUNCT_FLAG;
+  current->state = current->state & ~(READY_FLAG);
+
+  current->state = current->state | exit_code;
+
+  op_queue_push(schedule->defunct_queue, current);
+  OP_TRACE(schedule, OP_EV_TERMINATE, current);
+
+  return 0;
+}
+
+/* Parks a selected process that turned out to be asleep (blocked in a sleep or on I/O) instead of
+ *  leaving it on the CPU for a quantum it can't use.  It stays out of the Ready set, so it can't be
+ *  selected or stolen, until op_unpark sees recheck_ns has passed.  op_terminated and op_exited
+ *  still find it.
+ * Returns a 0 on success or a -1 on any error.
+ */
+int op_park(Op_schedule_s *schedule, Op_process_s *process, unsigned long long recheck_ns) {
+
+  if(schedule == NULL || process == NULL) {
     return -1;
   }
 
-  current = schedule->ready_queue_high->head;
+  process->recheck_ns = recheck_ns;
+  process->parks++;
+  op_queue_push(schedule->parked_queue, process);
+  return 0;
+}
 
-  if(current != NULL) {
-    
-    if(current->pid == pid) {/* Check Head of the Ready Queue High */
-      
-      schedule->ready_queue_high->head = current->next;
-      
-      current->next = NULL;
-      
-      current->state = current->state | DEFUNCT_FLAG;
-      current->state = current->state & ~(READY_FLAG);
-      schedule->ready_queue_high->count--;
-
-      current->state = current->state | exit_code;
-      
-      if(schedule->defunct_queue->head == NULL) {
-        
-        schedule->defunct_queue->head = current;
-        schedule->defunct_queue->count++;
-        return 0;
-      
-      }
-      iterator = schedule->defunct_queue->head;
-      
-      while (iterator->next != NULL) {
-        iterator = iterator->next;
-      }
+/* Returns every parked process whose recheck_ns is at or before now_ns to the Ready set.
+ * They are requeued as having yielded (no demotion or charge for the quantum they slept through).
+ * Returns the number of processes returned or -1 on any error.
+ */
+int op_unpark(Op_schedule_s *schedule, unsigned long long now_ns) {
+  Op_process_s *current = NULL;
+  Op_process_s *next = NULL;
+  int count = 0;
+
+  if(schedule == NULL) {
+    return -1;
+  }
 
-      iterator->next = current;
-      schedule->defunct_queue->count++;
-      return 0;      
-      
+  for(current = schedule->parked_queue->head; current != NULL; current = next) {
+    next = current->next;
+    if(current->recheck_ns > now_ns) {
+      continue;
+    }
+    op_queue_remove(schedule->parked_queue, current);
+    if(op_requeue(schedule, current, 0) != 0) {
+      op_queue_push(schedule->parked_queue, current); /* Try again on the next call */
+      break;
     }
+    count++;
+  }
+  return count;
+}
 
-    do{/* Iterate to find the process in the ready queue high */
-      prev = current;
-      current = current->next;
+/* MLFQ Policy (the default): Critical processes first, then level 0 (High) down to the lowest level (Low).
+ * Its Ready processes live in the schedule's own queues, so there is nothing to create or destroy.
+ */
+static int mlfq_create(Op_schedule_s *schedule) {
+  return 0;
+}
+
+/* New processes join High (or Critical), Low Priority ones join the lowest level.
+ */
+static int mlfq_add(Op_schedule_s *schedule, Op_process_s *process) {
+  if((LOW_FLAG & process->state) == LOW_FLAG) { /* Insert a node at ready queue low (the lowest level) */
+    op_push_level(schedule, process, schedule->mlfq.levels - 1);
+  } else { /* Insert a node at ready queue high (or critical) */
+    op_push_high(schedule, process);
+  }
+  return 0;
+}
 
-      if(current->pid == pid) {
-        
-        prev->next = current->next;
+/* Classic schedules put a process back where op_add would.  With MLFQ demotion on, a process
+ *  that used its whole quantum drops one level and one that yielded early keeps its level.
+ *  Critical processes are never demoted.
+ */
+static int mlfq_requeue(Op_schedule_s *schedule, Op_process_s *process, int used_quantum) {
+  int level = process->level;
 
-        current->next = NULL;
-        current->state = current->state | DEFUNCT_FLAG;
-        current->state = current->state & ~(READY_FLAG);
+  if(schedule->mlfq.demote == 0) {
+    return mlfq_add(schedule, process);
+  }
 
-        schedule->ready_queue_high->count--;
+  if(used_quantum && (process->state & CRITICAL_FLAG) == 0 && level < schedule->mlfq.levels - 1) {
+    level++;
+  }
 
-        current->state = current->state | exit_code;
+  op_push_level(schedule, process, level);
+  return 0;
+}
 
-        if (schedule->defunct_queue->head == NULL) {
-          schedule->defunct_queue->head = current;
-          schedule->defunct_queue->count++;
-          return 0;
-        }
+/* Unlinks the head of the highest non-empty level (Critical before level 0).
+ */
+static Op_process_s *mlfq_select(Op_schedule_s *schedule) {
+  Op_process_s *current = op_queue_pop(schedule->ready_queue_critical);
 
-        iterator = schedule->defunct_queue->head;
+  for(int i = 0; current == NULL && i < schedule->mlfq.levels; i++) {
+    current = op_queue_pop(schedule->ready_queues[i]);
+  }
 
-        while (iterator->next != NULL) {
-          iterator = iterator->next;
-        }
+  return current;
+}
 
-        iterator->next = current;
-        schedule->defunct_queue->count++;
-        return 0;
-     
-      }
+static void mlfq_exit(Op_schedule_s *schedule, Op_process_s *process) {
+}
+
+static void mlfq_terminate(Op_schedule_s *schedule, Op_process_s *process) {
+  op_queue_remove(process->queue, process);
+}
+
+/* Each level has its own quantum (classic Low Priority runs twice as long).
+ */
+static int mlfq_quantum(Op_schedule_s *schedule, Op_process_s *process) {
+  return schedule->mlfq.quantum[process->level];
+}
+
+static void mlfq_walk(Op_schedule_s *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg) {
+  for(Op_process_s *walker = schedule->ready_queue_critical->head; walker != NULL; walker = walker->next) {
+    visit(arg, walker);
+  }
+  for(int i = 0; i < schedule->mlfq.levels; i++) {
+    for(Op_process_s *walker = schedule->ready_queues[i]->head; walker != NULL; walker = walker->next) {
+      visit(arg, walker);
+    }
+  }
+}
+
+static void mlfq_destroy(Op_schedule_s *schedule) {
+}
+
+Op_policy_s op_policy_mlfq = {"mlfq", "Critical, then High/Low (or N MLFQ levels) with aging",
+  mlfq_create, mlfq_add, mlfq_requeue, mlfq_select, mlfq_tick, mlfq_exit, mlfq_terminate, mlfq_quantum, mlfq_walk, mlfq_destroy};
+
+Op_policy_s *op_policies[] = {&op_policy_mlfq, &op_policy_rr, &op_policy_fair, &op_policy_prio, &op_policy_stride, &op_policy_lottery, NULL};
+
+/* Switches the schedule to another policy, moving every queued process across.
+ * Processes keep their place in the PID index and their wait accounting, and join the new
+ *  policy in the order the old one would have run them.  A process on a CPU during the switch
+ *  simply comes back through op_requeue into the new policy.
+ * Returns a 0 on success or a -1 on any error (the schedule keeps its old policy and processes).
+ */
+int op_set_policy(Op_schedule_s *schedule, Op_policy_s *policy) {
+  Op_queue_s moving;
+  Op_process_s *current = NULL;
+  Op_policy_s *old_policy = NULL;
+  void *old_data = NULL;
+  void *new_data = NULL;
+
+  if(schedule == NULL || policy == NULL) {
+    return -1;
+  }
 
-    }while(current->next != NULL);
-    
+  if(schedule->policy == policy) {
+    return 0;
   }
 
-  current = schedule->ready_queue_low->head;
+  old_policy = schedule->policy;
+  old_data = schedule->policy_data;
+  schedule->policy_data = NULL;
+  if(policy->create(schedule) != 0) {
+    schedule->policy_data = old_data;
+    return -1;
+  }
+  new_data = schedule->policy_data;
 
-  if(current != NULL) {
-    
-    if(current->pid == pid) {/* Check Head of the Ready Queue Low */
-      
-      schedule->ready_queue_low->head = current->next;
-      
-      current->next = NULL;
-      
-      current->state = current->state | DEFUNCT_FLAG;
-      current->state = current->state & ~(READY_FLAG);
-      schedule->ready_queue_low->count--;
-
-      current->state = current->state | exit_code;
-      
-      if(schedule->defunct_queue->head == NULL) {
-        
-        schedule->defunct_queue->head = current;
-        schedule->defunct_queue->count++;
-        return 0;
-      
-      }
-      iterator = schedule->defunct_queue->head;
-      
-      while (iterator->next != NULL) {
-        iterator = iterator->next;
-      }
+  op_queue_init(&moving);
+  schedule->policy_data = old_data;
+  while((current = old_policy->select(schedule)) != NULL) {
+    op_queue_push(&moving, current);
+  }
 
-      iterator->next = current;
-      schedule->defunct_queue->count++;
-      return 0;      
-      
+  schedule->policy = policy;
+  schedule->policy_data = new_data;
+  while((current = op_queue_pop(&moving)) != NULL) {
+    if(policy->add(schedule, current) != 0) {
+      break;
     }
+  }
 
-    do{/* Iterate to find the process in the ready queue low */
-      prev = current;
-      current = current->next;
+  if(current != NULL) { /* Out of memory part way, everything goes back (the old policy still has room for it) */
+    op_queue_push(&moving, current);
+    while((current = policy->select(schedule)) != NULL) {
+      op_queue_push(&moving, current);
+    }
+    policy->destroy(schedule);
+    schedule->policy = old_policy;
+    schedule->policy_data = old_data;
+    while((current = op_queue_pop(&moving)) != NULL) {
+      old_policy->add(schedule, current);
+    }
+    return -1;
+  }
 
-      if(current->pid == pid) {
-        
-        prev->next = current->next;
+  schedule->policy = old_policy;
+  schedule->policy_data = old_data;
+  old_policy->destroy(schedule);
+  schedule->policy = policy;
+  schedule->policy_data = new_data;
 
-        current->next = NULL;
-        current->state = current->state | DEFUNCT_FLAG;
-        current->state = current->state & ~(READY_FLAG);
+  return 0;
+}
 
-        schedule->ready_queue_low->count--;
+/* Sets the seed for the random draws of a policy (lottery), so a run can be repeated.
+ * It takes effect the next time a policy is set up, so call it before op_set_policy.
+ * Every schedule starts with seed 0, the same draws each run.
+ */
+void op_set_seed(Op_schedule_s *schedule, unsigned long long seed) {
+  if(schedule == NULL) {
+    return;
+  }
+  schedule->seed = seed;
+}
 
-        current->state = current->state | exit_code;
+/* Looks up a policy in op_policies by name.
+ * Returns the policy or NULL if there is none by that name.
+ */
+Op_policy_s *op_find_policy(char *name) {
 
-        if (schedule->defunct_queue->head == NULL) {
-          schedule->defunct_queue->head = current;
-          schedule->defunct_queue->count++;
-          return 0;
-        }
+  if(name == NULL) {
+    return NULL;
+  }
 
-        iterator = schedule->defunct_queue->head;
+  for(int i = 0; op_policies[i] != NULL; i++) {
+    if(strcmp(op_policies[i]->name, name) == 0) {
+      return op_policies[i];
+    }
+  }
 
-        while (iterator->next != NULL) {
-          iterator = iterator->next;
-        }
+  return NULL;
+}
 
-        iterator->next = current;
-        schedule->defunct_queue->count++;
-        return 0;
+/* Calls visit with every process waiting in the schedule's policy (the Defunct Queue is not included).
+ * The processes must not be changed or unlinked from inside visit.
+ */
+void op_walk_ready(Op_schedule_s *schedule, void (*visit)(void *arg, Op_process_s *process), void *arg) {
 
-      }
-    }while(current->next != NULL);
-    
+  if(schedule == NULL || visit == NULL) {
+    return;
   }
 
-  return -1;
+  for(int i = 0; i < schedule->deadline_heap.count; i++) {
+    visit(arg, schedule->deadline_heap.items[i]);
+  }
+  schedule->policy->walk(schedule, visit, arg);
 }
 
-/* Frees all allocated memory in the Op_schedule_s, all of the Queues, and all of their Nodes.
- * Follow the project documentation for this function.
+/* Sets the hook called with every scheduler event (add, select, promote, exit, terminate).
+ * The hook runs inside the op_* call, so it must be quick and must not call back into the schedule.
+ * A NULL trace turns tracing off.
  */
-void op_deallocate(Op_schedule_s *schedule) {
+void op_set_trace(Op_schedule_s *schedule, Op_trace_fn trace, void *arg) {
 
-  Op_process_s *current;
+  if(schedule == NULL) {
+    return;
+  }
+
+  schedule->trace = trace;
+  schedule->trace_arg = arg;
+}
 
-  if(schedule->ready_queue_high->head != NULL) {/* Free ready queue high */
+/* Returns the queue number a process is traced under: its level,
+ *  OP_QUEUE_CRITICAL in the Critical Queue or OP_QUEUE_DEFUNCT once it has exited.
+ */
+int op_trace_queue(Op_process_s *process) {
 
-    while (schedule->ready_queue_high->head != NULL) {
-      current = schedule->ready_queue_high->head;
-      schedule->ready_queue_high->head = schedule->ready_queue_high->head->next;
-      free(current->cmd);
-      free(current);
-    }
+  if(process == NULL) {
+    return 0;
+  }
 
+  if((process->state & DEFUNCT_FLAG) != 0) {
+    return OP_QUEUE_DEFUNCT;
   }
 
-  if(schedule->ready_queue_low->head != NULL) {/* Free ready queue low */
-    
-    while (schedule->ready_queue_low->head != NULL) {
-      current = schedule->ready_queue_low->head;
-      schedule->ready_queue_low->head = schedule->ready_queue_low->head->next;
-      free(current->cmd);
-      free(current);
-    }
+  if(process->edf) {
+    return OP_QUEUE_DEADLINE;
+  }
 
+  if((process->state & CRITICAL_FLAG) != 0 && process->level == 0) {
+    return OP_QUEUE_CRITICAL;
   }
 
-  if(schedule->defunct_queue->head != NULL) {/* Free defunct queue */
-   
-    while (schedule->defunct_queue->head != NULL) {
-      current = schedule->defunct_queue->head;
-      schedule->defunct_queue->head = schedule->defunct_queue->head->next;
-      free(current->cmd);
-      free(current);
-      }
-    }
+  return process->level;
+}
+
+/* Frees every node in a single queue and leaves it empty.
+ */
+static void op_queue_free(Op_queue_s *queue) {
+  Op_process_s *current;
+
+  while((current = op_queue_pop(queue)) != NULL) {
+    op_free_process(current);
+  }
+}
+
+/* Frees all allocated memory in the Op_schedule_s, all of the Queues, and all of their Nodes.
+ * Follow the project documentation for this function.
+ */
+void op_deallocate(Op_schedule_s *schedule) {
 
+  if(schedule == NULL) {
+    return;
+  }
 
+  /*Free all nodes, then the policy, the queues + Schedule */
+  if(schedule->policy != NULL) {
+    Op_process_s *current;
+    while((current = schedule->policy->select(schedule)) != NULL) {
+      op_free_process(current);
+    }
+    schedule->policy->destroy(schedule);
+  }
 
-  
+  if(schedule->deadline_heap.items != NULL) {
+    Op_process_s *current;
+    while((current = op_heap_pop(&schedule->deadline_heap)) != NULL) {
+      op_free_process(current);
+    }
+    free(schedule->deadline_heap.items);
+  }
 
-  /*Free queues + Schedule */
-  if(schedule->ready_queue_high != NULL) {
-    free(schedule->ready_queue_high);
+  if(schedule->ready_queue_critical != NULL) {
+    op_queue_free(schedule->ready_queue_critical);
+    free(schedule->ready_queue_critical);
   }
 
-  if(schedule->ready_queue_low != NULL) {
-    free(schedule->ready_queue_low);
+  for(int i = 0; i < OP_MAX_LEVELS; i++) { /* High and Low are levels too */
+    if(schedule->ready_queues[i] != NULL) {
+      op_queue_free(schedule->ready_queues[i]);
+      free(schedule->ready_queues[i]);
+    }
   }
 
   if(schedule->defunct_queue != NULL) {
+    op_queue_free(schedule->defunct_queue);
     free(schedule->defunct_queue);
   }
 
-  if(schedule != NULL) {
-    free(schedule);
+  if(schedule->parked_queue != NULL) {
+    op_queue_free(schedule->parked_queue);
+    free(schedule->parked_queue);
+  }
+
+  if(schedule->pid_index != NULL) {
+    free(schedule->pid_index->slots);
+    free(schedule->pid_index);
   }
+
+  free(schedule);
 }
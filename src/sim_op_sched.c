@@ -0,0 +1,254 @@
+/*
+ * - sim_op_sched.c (Trilby VM)
+ * Discrete-event simulator for the Scheduler.
+ * - Drives op_add/op_select/op_promote_processes/op_requeue/op_exited from a virtual
+ *   clock instead of forking, so policies can be compared at 100k+ jobs.
+ * - Jobs arrive as a Poisson process and each needs a CPU burst drawn from
+ *   an exponential, fixed or heavy-tailed (Pareto) distribution.
+ * - The same seed always gives the same schedule.
+ *
+ * eg. ./sim -n 100000 -r 50 -b 15 -c 0.05 -l 0.3 -q 10 -m 3 -D -P mlfq
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+// Local Includes
+#include "vm_support.h"
+#include "op_sched.h"
+
+#define SIM_NS_PER_MS 1000000.0
+
+int debug_mode = 0; // Keeps print_debug quiet
+
+// Synthetic Job Model and Scheduler Settings
+typedef struct sim_config {
+  int jobs;              // Jobs to run to completion
+  double rate;           // Arrivals per second (Poisson)
+  double burst_ms;       // Mean CPU burst per job
+  char dist;             // 'e'xponential, 'f'ixed or 'p'areto (alpha 1.5) bursts
+  double critical;       // Fraction of jobs that are Critical
+  double low;            // Fraction of jobs that start Low Priority
+  double quantum_ms;     // Base runtime quantum (each level multiplies it)
+  double switch_ms;      // Context switch cost charged after every quantum
+  unsigned long long seed;
+  Op_mlfq_s mlfq;
+  Op_policy_s *policy;   // Scheduling policy under test
+} sim_config_s;
+
+// Per-job results (indexed by pid - 1)
+typedef struct sim_job {
+  double arrival;  // ns on the virtual clock
+  double burst;    // CPU needed, ns
+  double left;     // CPU still needed, ns
+  double first;    // First dispatch, ns (-1 until run)
+  double finish;   // ns
+  int is_critical;
+  int is_low;
+} sim_job_s;
+
+static unsigned long long sim_rng = 0;
+
+// Local Prototypes
+static double sim_random();
+static double sim_exponential(double mean);
+static double sim_burst(sim_config_s *config);
+static int sim_compare(const void *a, const void *b);
+static void sim_print_dist(char *name, double *values, int count);
+static void sim_usage(char *name);
+
+int main(int argc, char *argv[]) {
+  sim_config_s config = {100000, 50.0, 15.0, 'e', 0.05, 0.30, 10.0, 0.0, 1, {0}, op_policies[0]};
+  Op_schedule_s *schedule = NULL;
+  Op_process_s *proc = NULL;
+  sim_job_s *jobs = NULL;
+  double *wait = NULL, *response = NULL, *turnaround = NULL;
+  double now = 0, next_arrival = 0, busy = 0, share_sum = 0, share_sq_sum = 0;
+  unsigned long quanta = 0;
+  int arrived = 0, done = 0, opt = 0;
+  struct timespec real_start, real_end;
+
+  op_mlfq_classic(&config.mlfq);
+  while((opt = getopt(argc, argv, "n:r:b:d:c:l:q:x:m:B:Ds:P:h")) != -1) {
+    switch(opt) {
+      case 'n': config.jobs = atoi(optarg); break;
+      case 'r': config.rate = atof(optarg); break;
+      case 'b': config.burst_ms = atof(optarg); break;
+      case 'd': config.dist = optarg[0]; break;
+      case 'c': config.critical = atof(optarg); break;
+      case 'l': config.low = atof(optarg); break;
+      case 'q': config.quantum_ms = atof(optarg); break;
+      case 'x': config.switch_ms = atof(optarg); break;
+      case 'm': // N level MLFQ, each level's quantum doubles
+        config.mlfq.levels = atoi(optarg);
+        for(int i = 0; i < OP_MAX_LEVELS; i++) {
+          config.mlfq.quantum[i] = 1 << i;
+        }
+        break;
+      case 'B': config.mlfq.boost_ticks = atoi(optarg); break;
+      case 'D': config.mlfq.demote = 1; break;
+      case 's': config.seed = strtoull(optarg, NULL, 10); break;
+      case 'P': config.policy = op_find_policy(optarg); break;
+      default: sim_usage(argv[0]); return 1;
+    }
+  }
+  if(config.jobs < 1 || config.rate <= 0 || config.burst_ms <= 0 || config.quantum_ms <= 0 || strchr("efp", config.dist) == NULL || config.policy == NULL) {
+    sim_usage(argv[0]);
+    return 1;
+  }
+
+  schedule = op_create();
+  jobs = calloc(config.jobs, sizeof(sim_job_s));
+  wait = malloc(config.jobs * sizeof(double));
+  response = malloc(config.jobs * sizeof(double));
+  turnaround = malloc(config.jobs * sizeof(double));
+  if(schedule == NULL || jobs == NULL || wait == NULL || response == NULL || turnaround == NULL) {
+    abort_error("...Could not allocate the simulation.", __FILE__);
+  }
+  if(op_set_mlfq(schedule, &config.mlfq) != 0) {
+    abort_error("...Invalid MLFQ settings (-m 2 to 8 levels).", __FILE__);
+  }
+  op_set_seed(schedule, config.seed); // Lottery draws repeat with the job stream
+  if(op_set_policy(schedule, config.policy) != 0) {
+    abort_error("...Could not set up the scheduling policy.", __FILE__);
+  }
+
+  // The whole job stream is drawn up front so the schedule can't change the random sequence
+  sim_rng = config.seed ? config.seed : 1;
+  for(int i = 0; i < config.jobs; i++) {
+    next_arrival += sim_exponential(1e9 / config.rate);
+    jobs[i].arrival = next_arrival;
+    jobs[i].burst = jobs[i].left = sim_burst(&config);
+    jobs[i].first = -1;
+    double kind = sim_random();
+    jobs[i].is_critical = kind < config.critical;
+    jobs[i].is_low = !jobs[i].is_critical && kind < config.critical + config.low;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &real_start);
+  while(done < config.jobs) {
+    // Admit everything that has arrived by now
+    while(arrived < config.jobs && jobs[arrived].arrival <= now) {
+      proc = op_new_process("sim", arrived + 1, jobs[arrived].is_low, jobs[arrived].is_critical);
+      if(proc == NULL || op_add(schedule, proc) != 0) {
+        abort_error("...Could not add a simulated job.", __FILE__);
+      }
+      arrived++;
+    }
+
+    proc = op_select(schedule);
+    op_promote_processes(schedule);
+    if(proc == NULL) { // Idle, jump the clock to the next arrival
+      now = jobs[arrived].arrival;
+      continue;
+    }
+
+    // Run one quantum (or less if the job finishes first)
+    sim_job_s *job = &jobs[proc->pid - 1];
+    double slice = config.quantum_ms * SIM_NS_PER_MS * op_get_quantum(schedule, proc);
+    double run = (job->left < slice) ? job->left : slice;
+    if(job->first < 0) {
+      job->first = now;
+    }
+    now += run;
+    busy += run;
+    job->left -= run;
+    proc->cpu_ns += run; // What /proc schedstat reports in the VM
+    quanta++;
+
+    if(job->left <= 0) {
+      job->finish = now;
+      op_exited(schedule, proc, 0);
+      op_queue_remove(schedule->defunct_queue, proc); // Results live in jobs[], keep memory flat
+      op_free_process(proc);
+      done++;
+    }
+    else {
+      op_requeue(schedule, proc, 1); // Ran its whole quantum
+    }
+    now += config.switch_ms * SIM_NS_PER_MS;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &real_end);
+
+  for(int i = 0; i < config.jobs; i++) {
+    turnaround[i] = jobs[i].finish - jobs[i].arrival;
+    wait[i] = turnaround[i] - jobs[i].burst; // One CPU and no I/O: time not running is time waiting
+    response[i] = jobs[i].first - jobs[i].arrival;
+    double share = jobs[i].burst / turnaround[i];
+    share_sum += share;
+    share_sq_sum += share * share;
+  }
+
+  double real = (real_end.tv_sec - real_start.tv_sec) + (real_end.tv_nsec - real_start.tv_nsec) / 1e9;
+  printf("jobs %d | rate %.2f/s | burst %.2f ms (%c) | critical %.2f | low %.2f | quantum %.2f ms | %s levels %d%s | seed %llu\n",
+      config.jobs, config.rate, config.burst_ms, config.dist, config.critical, config.low, config.quantum_ms,
+      config.policy->name, config.mlfq.levels, config.mlfq.demote ? " demote" : "", config.seed);
+  printf("makespan %.3f s | throughput %.3f jobs/s | utilization %.1f%% | %lu quanta\n",
+      now / 1e9, config.jobs / (now / 1e9), 100.0 * busy / now, quanta);
+  sim_print_dist("wait", wait, config.jobs);
+  sim_print_dist("response", response, config.jobs);
+  sim_print_dist("turnaround", turnaround, config.jobs);
+  printf("jain fairness (cpu share) %.4f\n", (share_sum * share_sum) / (config.jobs * share_sq_sum));
+  printf("simulated %.1f s in %.3f s real (%.0fx real time)\n", now / 1e9, real, (now / 1e9) / real);
+
+  free(jobs);
+  free(wait);
+  free(response);
+  free(turnaround);
+  op_deallocate(schedule);
+  op_pool_release();
+  return 0;
+}
+
+// Uniform random number in (0, 1) from xorshift64* (deterministic for a seed)
+static double sim_random() {
+  sim_rng ^= sim_rng >> 12;
+  sim_rng ^= sim_rng << 25;
+  sim_rng ^= sim_rng >> 27;
+  return ((sim_rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0) + 1e-18;
+}
+
+// Exponentially distributed value with the given mean
+static double sim_exponential(double mean) {
+  return -mean * log(sim_random());
+}
+
+// CPU burst for one job in ns
+static double sim_burst(sim_config_s *config) {
+  double mean = config->burst_ms * SIM_NS_PER_MS;
+  switch(config->dist) {
+    case 'f':
+      return mean;
+    case 'p': // Pareto with alpha 1.5 scaled to the same mean: many short jobs, a few huge ones
+      return (mean / 3.0) / pow(sim_random(), 1.0 / 1.5);
+    default:
+      return sim_exponential(mean);
+  }
+}
+
+static int sim_compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Sorts values (ns) and prints mean, p50, p99 and max in msec
+static void sim_print_dist(char *name, double *values, int count) {
+  double sum = 0;
+
+  qsort(values, count, sizeof(double), sim_compare);
+  for(int i = 0; i < count; i++) {
+    sum += values[i];
+  }
+  printf("%-10s mean %12.3f ms | p50 %12.3f ms | p99 %12.3f ms | max %12.3f ms\n", name,
+      sum / count / SIM_NS_PER_MS, values[count / 2] / SIM_NS_PER_MS,
+      values[(count * 99 + 99) / 100 - 1] / SIM_NS_PER_MS, values[count - 1] / SIM_NS_PER_MS);
+}
+
+static void sim_usage(char *name) {
+  fprintf(stderr, "usage: %s [-n jobs] [-r arrivals/s] [-b mean burst ms] [-d e|f|p] [-c critical fraction]\n"
+      "          [-l low fraction] [-q quantum ms] [-x switch ms] [-m levels] [-D] [-B boost ticks] [-s seed]\n"
+      "          [-P policy]\n", name);
+}
@@ -6,14 +6,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
 // Local Includes
 #include "vm_support.h" // Gives abort_error, print_warning, print_status, print_debug commands
 #include "op_sched.h" // Your header for the functions you're testing.
+#include "vm_process.h" // MAX_AGE
 
 int debug_mode = 1; // Hardcodes debug on for the custom print functions
 
 // Local Prototypes
 void test_op_create();
+void test_op_find();
+void test_op_select_high();
+void test_op_promote_processes();
+void test_op_mlfq();
+void test_op_inbox();
+void test_op_accounting();
+void test_op_policy();
+void test_op_fair();
+void test_op_prio();
+void test_op_deadline();
+void test_op_stride();
+void test_op_observe();
+void test_op_park();
+
+#define INBOX_PRODUCERS 8         // Concurrent submitter threads in the inbox stress test
+#define INBOX_PER_PRODUCER 25000  // Processes each submitter pushes
+
+// Shared by the inbox stress test threads
+typedef struct inbox_producer {
+  Op_inbox_s *inbox;
+  int first_pid;
+  unsigned long full; // Times this submitter found the inbox full and had to retry
+} inbox_producer_s;
 
 int main() {
   // print_status is a helper function to print a message when you run the code.
@@ -21,6 +49,32 @@ int main() {
   print_status("Test 1: Testing OP Create");
   // Call this local function to test your op_create code.
   test_op_create();
+  print_status("Test 2: Testing OP Find and OP Terminated");
+  test_op_find();
+  print_status("Test 3: Testing OP Select High with Critical Processes");
+  test_op_select_high();
+  print_status("Test 4: Testing OP Promote Processes");
+  test_op_promote_processes();
+  print_status("Test 5: Testing OP MLFQ Demotion and Boost");
+  test_op_mlfq();
+  print_status("Test 6: Stress Testing the Lock-free Submission Inbox");
+  test_op_inbox();
+  print_status("Test 7: Testing OP Wait and Turnaround Accounting");
+  test_op_accounting();
+  print_status("Test 8: Testing OP Policy Switching");
+  test_op_policy();
+  print_status("Test 9: Testing OP Fair Policy Shares");
+  test_op_fair();
+  print_status("Test 10: Testing OP Prio Bitmap Levels and Aging");
+  test_op_prio();
+  print_status("Test 11: Testing OP Deadline (EDF) Class");
+  test_op_deadline();
+  print_status("Test 12: Testing OP Stride and Lottery Ticket Shares");
+  test_op_stride();
+  print_status("Test 13: Testing OP Observe CPU/I/O-bound Classification");
+  test_op_observe();
+  print_status("Test 14: Testing OP Park and Unpark of Sleeping Processes");
+  test_op_park();
 
   return 0;
 }
@@ -61,3 +115,724 @@ void test_op_create() {
   print_status("...op_create is looking good so far.");
   return;
 }
+
+// Local function to test the PID index behind op_find and op_terminated
+void test_op_find() {
+  Op_schedule_s *header = op_create();
+  int i = 0;
+
+  if(header == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+
+  // Enough processes to force the index to grow a few times
+  print_debug("...Adding 1000 processes, alternating High and Low");
+  for(i = 1; i <= 1000; i++) {
+    op_add(header, op_new_process("test", i, i & 1, 0));
+  }
+  for(i = 1; i <= 1000; i++) {
+    if(op_find(header, i) == NULL || op_find(header, i)->pid != i) {
+      abort_error("...op_find missed a queued process.", __FILE__);
+    }
+  }
+  if(op_find(header, 1001) != NULL) {
+    abort_error("...op_find returned a process that was never added.", __FILE__);
+  }
+
+  print_debug("...Terminating every third process");
+  for(i = 3; i <= 1000; i += 3) {
+    if(op_terminated(header, i, 9) != 0) {
+      abort_error("...op_terminated could not find a queued process.", __FILE__);
+    }
+    if(op_find(header, i) != NULL) {
+      abort_error("...op_find still returns a terminated process.", __FILE__);
+    }
+  }
+  if(op_terminated(header, 3, 9) != -1) {
+    abort_error("...op_terminated removed the same process twice.", __FILE__);
+  }
+  if(op_get_count(header->defunct_queue) != 333) {
+    abort_error("...Defunct Queue count is wrong after op_terminated.", __FILE__);
+  }
+  if(op_get_count(header->ready_queue_high) + op_get_count(header->ready_queue_low) != 667) {
+    abort_error("...Ready Queue counts are wrong after op_terminated.", __FILE__);
+  }
+
+  print_debug("...Selected processes leave the index");
+  Op_process_s *selected = op_select_high(header);
+  if(selected == NULL || op_find(header, selected->pid) != NULL) {
+    abort_error("...op_find still returns a selected process.", __FILE__);
+  }
+  op_add(header, selected);
+  if(op_find(header, selected->pid) != selected) {
+    abort_error("...op_find lost a re-added process.", __FILE__);
+  }
+
+  op_deallocate(header);
+  print_status("...op_find and op_terminated are looking good so far.");
+}
+
+// Local function to test that Critical processes are selected first, in FIFO order
+void test_op_select_high() {
+  Op_schedule_s *header = op_create();
+  pid_t expected[] = {2, 4, 1, 3};
+  Op_process_s *selected = NULL;
+  int i = 0;
+
+  if(header == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+
+  // 1 and 3 are High, 2 and 4 are Critical
+  op_add(header, op_new_process("test", 1, 0, 0));
+  op_add(header, op_new_process("test", 2, 0, 1));
+  op_add(header, op_new_process("test", 3, 0, 0));
+  op_add(header, op_new_process("test", 4, 0, 1));
+
+  for(i = 0; i < 4; i++) {
+    selected = op_select_high(header);
+    if(selected == NULL || selected->pid != expected[i]) {
+      abort_error("...op_select_high returned the wrong process.", __FILE__);
+    }
+    op_exited(header, selected, 0);
+  }
+  if(op_select_high(header) != NULL) {
+    abort_error("...op_select_high returned a process from an empty queue.", __FILE__);
+  }
+
+  op_deallocate(header);
+  print_status("...op_select_high is looking good so far.");
+}
+
+// Local function to test that Low processes are promoted after exactly MAX_AGE ticks
+void test_op_promote_processes() {
+  Op_schedule_s *header = op_create();
+  int tick = 0;
+
+  if(header == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+
+  // 1 joins at tick 0, 2 joins at tick 2
+  op_add(header, op_new_process("test", 1, 1, 0));
+  for(tick = 1; tick <= MAX_AGE + 2; tick++) {
+    if(tick == 3) {
+      op_add(header, op_new_process("test", 2, 1, 0));
+    }
+    op_promote_processes(header);
+
+    if(op_find(header, 1)->queue != ((tick >= MAX_AGE) ? header->ready_queue_high : header->ready_queue_low)) {
+      abort_error("...Process 1 was not promoted at MAX_AGE.", __FILE__);
+    }
+    if(tick >= 3 && op_find(header, 2)->queue != ((tick >= MAX_AGE + 2) ? header->ready_queue_high : header->ready_queue_low)) {
+      abort_error("...Process 2 was not promoted at MAX_AGE.", __FILE__);
+    }
+  }
+
+  if(op_get_count(header->ready_queue_low) != 0 || op_get_count(header->ready_queue_high) != 2) {
+    abort_error("...Queue counts are wrong after promotion.", __FILE__);
+  }
+
+  op_deallocate(header);
+  print_status("...op_promote_processes is looking good so far.");
+}
+
+// Local function to test MLFQ demotion, early yields, per-level quanta and boosting
+void test_op_mlfq() {
+  Op_schedule_s *header = op_create();
+  Op_mlfq_s config;
+  Op_process_s *selected = NULL;
+  int i = 0;
+
+  if(header == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+
+  op_mlfq_classic(&config);
+  config.levels = 3;
+  config.quantum[1] = 3;
+  config.quantum[2] = 4;
+  config.demote = 1;
+  config.boost_ticks = 10;
+  if(op_set_mlfq(header, &config) != 0) {
+    abort_error("...op_set_mlfq rejected valid settings.", __FILE__);
+  }
+
+  // 1 is a CPU hog, 2 always yields early (and so keeps level 0 ahead of the hog)
+  op_add(header, op_new_process("hog", 1, 0, 0));
+  op_add(header, op_new_process("io", 2, 0, 0));
+  for(i = 0; i < 4; i++) {
+    selected = op_select(header);
+    op_promote_processes(header);
+    op_requeue(header, selected, selected->pid == 1);
+  }
+  if(op_find(header, 1)->level != 1 || op_find(header, 2)->level != 0) {
+    abort_error("...Demotion or early-yield handling is wrong.", __FILE__);
+  }
+  if(op_get_quantum(header, op_find(header, 1)) != 3) {
+    abort_error("...op_get_quantum ignored the level quantum.", __FILE__);
+  }
+
+  // The 10th tick boosts the hog back to level 0
+  for(i = 4; i < 10; i++) {
+    op_promote_processes(header);
+  }
+  if(op_find(header, 1)->level != 0 || op_find(header, 1)->queue != header->ready_queue_high) {
+    abort_error("...The periodic boost did not reach level 0.", __FILE__);
+  }
+
+  // Shrinking the level count keeps every process
+  op_requeue(header, op_select(header), 1);
+  op_mlfq_classic(&config);
+  if(op_set_mlfq(header, &config) != 0 || op_get_count(header->ready_queue_high) + op_get_count(header->ready_queue_low) != 2) {
+    abort_error("...op_set_mlfq lost processes going back to High/Low.", __FILE__);
+  }
+
+  op_deallocate(header);
+  print_status("...MLFQ is looking good so far.");
+}
+
+// Submitter thread for test_op_inbox, pushes its own range of pids
+static void *inbox_producer(void *args) {
+  inbox_producer_s *producer = (inbox_producer_s *)args;
+  for(int i = 0; i < INBOX_PER_PRODUCER; i++) {
+    Op_process_s *process = op_new_process("submit", producer->first_pid + i, i & 1, 0);
+    while(op_inbox_push(producer->inbox, process) != 0) {
+      producer->full++;
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+// Local function to stress the inbox with many concurrent submitters and one draining consumer
+void test_op_inbox() {
+  Op_schedule_s *header = op_create();
+  Op_inbox_s *inbox = malloc(sizeof(Op_inbox_s));
+  pthread_t threads[INBOX_PRODUCERS];
+  inbox_producer_s producers[INBOX_PRODUCERS];
+  struct timespec start, end;
+  char msg[MAX_STATUS] = {0};
+  unsigned long full = 0;
+  int total = INBOX_PRODUCERS * INBOX_PER_PRODUCER;
+  int drained = 0;
+  int i = 0;
+
+  if(header == NULL || inbox == NULL) {
+    abort_error("...Could not allocate the schedule or inbox!", __FILE__);
+  }
+  op_inbox_init(inbox);
+  if(op_inbox_pop(inbox) != NULL || op_inbox_count(inbox) != 0) {
+    abort_error("...A new inbox is not empty.", __FILE__);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < INBOX_PRODUCERS; i++) {
+    producers[i].inbox = inbox;
+    producers[i].first_pid = 1 + i * INBOX_PER_PRODUCER;
+    producers[i].full = 0;
+    if(pthread_create(&threads[i], NULL, inbox_producer, &producers[i]) != 0) {
+      abort_error("...Could not start a submitter thread.", __FILE__);
+    }
+  }
+  // This thread is the single consumer, like a dispatcher draining in batches
+  while(drained < total) {
+    drained += op_inbox_drain(inbox, header, 64);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  for(i = 0; i < INBOX_PRODUCERS; i++) {
+    pthread_join(threads[i], NULL);
+    full += producers[i].full;
+  }
+
+  // Every pid arrives exactly once
+  if(op_get_ready_count(header) != total || op_inbox_count(inbox) != 0 || op_inbox_pop(inbox) != NULL) {
+    abort_error("...The inbox lost or duplicated submissions.", __FILE__);
+  }
+  for(i = 1; i <= total; i++) {
+    if(op_find(header, i) == NULL) {
+      abort_error("...A submitted process never reached the schedule.", __FILE__);
+    }
+  }
+
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  sprintf(msg, "...%d submissions from %d threads in %.3f sec (%.2f M/sec, %lu full retries)", total, INBOX_PRODUCERS, secs, total / secs / 1e6, full);
+  print_status(msg);
+
+  free(inbox);
+  op_deallocate(header);
+  print_status("...The Submission Inbox is looking good so far.");
+}
+
+// Local function to test the wait, low-queue wait and exit timestamps kept on each node
+void test_op_accounting() {
+  Op_schedule_s *header = op_create();
+  Op_process_s *high = op_new_process("high", 1, 0, 0);
+  Op_process_s *low = op_new_process("low", 2, 1, 0);
+
+  if(header == NULL || high == NULL || low == NULL) {
+    abort_error("...op_create or op_new_process returned NULL!", __FILE__);
+  }
+  if(high->submit_ns == 0 || high->wait_ns != 0 || high->exit_ns != 0) {
+    abort_error("...op_new_process did not reset the accounting fields.", __FILE__);
+  }
+
+  op_add(header, high);
+  op_add(header, low);
+  usleep(2000);
+  if(op_select(header) != high || high->wait_ns < 2000000 || high->low_wait_ns != 0) {
+    abort_error("...Waiting in the High Queue was not charged as wait time.", __FILE__);
+  }
+  if(op_select(header) != low || low->low_wait_ns < 2000000 || low->low_wait_ns > low->wait_ns) {
+    abort_error("...Waiting in the Low Queue was not charged as low wait time.", __FILE__);
+  }
+
+  op_exited(header, high, 0);
+  op_requeue(header, low, 1);
+  op_terminated(header, 2, 9);
+  if(high->exit_ns < high->submit_ns || low->exit_ns < low->submit_ns + low->wait_ns) {
+    abort_error("...Exit times are missing or earlier than submit plus wait.", __FILE__);
+  }
+
+  op_deallocate(header);
+  print_status("...Accounting is looking good so far.");
+}
+
+// Local function to test switching policies with processes queued
+void test_op_policy() {
+  Op_schedule_s *header = op_create();
+  Op_process_s *selected = NULL;
+
+  if(header == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+  if(header->policy != op_policies[0] || op_find_policy("rr") != &op_policy_rr || op_find_policy("nope") != NULL) {
+    abort_error("...The policy table is wrong.", __FILE__);
+  }
+
+  // MLFQ runs 3 (Critical) then 2 (High) then 1 (Low)
+  op_add(header, op_new_process("low", 1, 1, 0));
+  op_add(header, op_new_process("high", 2, 0, 0));
+  op_add(header, op_new_process("crit", 3, 0, 1));
+  if(op_set_policy(header, &op_policy_rr) != 0 || op_get_ready_count(header) != 3) {
+    abort_error("...op_set_policy lost processes moving to rr.", __FILE__);
+  }
+  if(op_get_count(header->ready_queue_critical) + op_get_count(header->ready_queue_high) + op_get_count(header->ready_queue_low) != 0) {
+    abort_error("...op_set_policy left processes in the MLFQ queues.", __FILE__);
+  }
+
+  // rr keeps the order they moved across in, and a requeued process goes to the back
+  selected = op_select(header);
+  if(selected == NULL || selected->pid != 3) {
+    abort_error("...rr did not keep the MLFQ run order.", __FILE__);
+  }
+  op_requeue(header, selected, 1);
+  if(op_terminated(header, 2, 9) != 0 || op_find(header, 2) != NULL) {
+    abort_error("...op_terminated failed under rr.", __FILE__);
+  }
+  selected = op_select(header);
+  if(selected->pid != 1 || op_get_quantum(header, op_find(header, 3)) != 1) {
+    abort_error("...rr selected out of order.", __FILE__);
+  }
+
+  // Back to MLFQ with a process still out on the CPU, it rejoins through op_requeue
+  if(op_set_policy(header, &op_policy_mlfq) != 0 || op_get_count(header->ready_queue_critical) != 1) {
+    abort_error("...op_set_policy lost processes moving back to MLFQ.", __FILE__);
+  }
+  op_requeue(header, selected, 1);
+  if(selected->queue != header->ready_queue_low) {
+    abort_error("...A process back from the CPU missed the new policy.", __FILE__);
+  }
+  op_exited(header, op_find(header, 3), 0); // Exits straight out of a Ready Queue
+  if(op_get_ready_count(header) != 1 || op_get_count(header->defunct_queue) != 2) {
+    abort_error("...op_exited did not unlink a queued process.", __FILE__);
+  }
+
+  op_deallocate(header);
+  print_status("...Policy switching is looking good so far.");
+}
+
+// Local function to test the fair policy splits CPU time by priority weight
+void test_op_fair() {
+  Op_schedule_s *header = op_create();
+  Op_process_s *selected = NULL;
+  int runs[5] = {0};
+
+  if(header == NULL || op_set_policy(header, &op_policy_fair) != 0) {
+    abort_error("...Could not set up the fair policy.", __FILE__);
+  }
+  Op_process_s *bad = op_new_process("bad", 9, 0, 0);
+  if(op_set_priority(bad, MAX_PRIORITY + 1) != -1) {
+    abort_error("...op_set_priority took an out of range priority.", __FILE__);
+  }
+  op_free_process(bad);
+
+  // 1 and 2 share the default weight, 3 is 16 levels up (twice the weight)
+  for(int pid = 1; pid <= 3; pid++) {
+    Op_process_s *process = op_new_process("fair", pid, 0, 0);
+    op_set_priority(process, (pid == 3) ? DEFAULT_PRIORITY + 16 : DEFAULT_PRIORITY);
+    op_add(header, process);
+  }
+  for(int i = 0; i < 4000; i++) { // Every slice runs 10ms of CPU
+    selected = op_select(header);
+    selected->cpu_ns += 10000000ULL;
+    runs[selected->pid]++;
+    op_requeue(header, selected, 1);
+    if(runs[1] - runs[2] > 1 || runs[2] - runs[1] > 1) {
+      abort_error("...Equal priorities drifted more than one slice apart.", __FILE__);
+    }
+  }
+  if(runs[3] < runs[1] * 19 / 10 || runs[3] > runs[1] * 21 / 10) {
+    abort_error("...Priority +16 did not get twice the CPU.", __FILE__);
+  }
+
+  // A newcomer starts level with the others instead of owed 40s of CPU
+  op_add(header, op_new_process("late", 4, 0, 0));
+  for(int i = 0; i < 20; i++) {
+    selected = op_select(header);
+    selected->cpu_ns += 10000000ULL;
+    runs[selected->pid]++;
+    op_requeue(header, selected, 1);
+  }
+  if(runs[4] > 6) {
+    abort_error("...A new process got credit for time before it joined.", __FILE__);
+  }
+  // One stolen from a busier CPU starts level too, instead of waiting out that CPU's vruntime
+  Op_process_s *stolen = op_new_process("stolen", 5, 0, 0);
+  int runs_stolen = 0;
+  stolen->vruntime = 1ULL << 50;
+  op_add(header, stolen);
+  for(int i = 0; i < 20; i++) {
+    selected = op_select(header);
+    selected->cpu_ns += 10000000ULL;
+    runs_stolen += (selected->pid == 5);
+    op_requeue(header, selected, 1);
+  }
+  if(runs_stolen == 0) {
+    abort_error("...A migrated process kept the vruntime of the CPU it came from.", __FILE__);
+  }
+
+  if(op_terminated(header, 3, 9) != 0 || op_get_ready_count(header) != 4) {
+    abort_error("...op_terminated failed under fair.", __FILE__);
+  }
+  op_deallocate(header);
+  print_status("...Fair shares are looking good so far.");
+}
+
+// Local function to test the prio policy runs the highest level first and ages waiting processes up
+void test_op_prio() {
+  Op_schedule_s *header = op_create();
+  Op_process_s *selected = NULL;
+  int priorities[5] = {0, 1, 200, 64, 255};
+
+  if(header == NULL || op_set_policy(header, &op_policy_prio) != 0) {
+    abort_error("...Could not set up the prio policy.", __FILE__);
+  }
+  for(int pid = 1; pid <= 4; pid++) {
+    Op_process_s *process = op_new_process("prio", pid, 0, 0);
+    op_set_priority(process, priorities[pid]);
+    op_add(header, process);
+  }
+  op_add(header, op_new_process("crit", 5, 0, 1));
+
+  // Critical first, then 255, 200, 64, 1
+  int order[5] = {5, 4, 2, 3, 1};
+  for(int i = 0; i < 5; i++) {
+    selected = op_select(header);
+    if(selected == NULL || selected->pid != order[i]) {
+      abort_error("...prio did not select the highest level first.", __FILE__);
+    }
+    op_exited(header, selected, 0);
+  }
+  if(op_select(header) != NULL) {
+    abort_error("...prio selected from an empty schedule.", __FILE__);
+  }
+
+  // A priority 1 process waits behind a busy 100 but climbs past it by aging (its level is aged every MAX_AGE ticks)
+  Op_process_s *busy = op_new_process("busy", 6, 0, 0);
+  Op_process_s *starved = op_new_process("starved", 7, 0, 0);
+  op_set_priority(busy, 100);
+  op_set_priority(starved, MIN_PRIORITY);
+  op_add(header, busy);
+  op_add(header, starved);
+  int ticks = 0;
+  while((selected = op_select(header)) == busy && ticks < 1000) {
+    op_promote_processes(header);
+    op_requeue(header, selected, 1);
+    ticks++;
+  }
+  if(selected != starved || ticks > ((100 - MIN_PRIORITY) / PRIO_AGE_LEVELS + 1) * 2 * MAX_AGE) {
+    abort_error("...Aging did not lift the starved process in time.", __FILE__);
+  }
+  op_requeue(header, selected, 1);
+  if(selected->prio_level != MIN_PRIORITY || op_terminated(header, 7, 9) != 0 || op_select(header) != busy) {
+    abort_error("...A process did not drop back to its own level after running.", __FILE__);
+  }
+  op_requeue(header, busy, 1);
+
+  // Everyone on an aged level that has waited long enough rises, not just the head
+  Op_process_s *waiting[3] = {NULL};
+  for(int i = 0; i < 3; i++) {
+    waiting[i] = op_new_process("waiting", 8 + i, 0, 0);
+    op_set_priority(waiting[i], MIN_PRIORITY);
+    op_add(header, waiting[i]);
+  }
+  for(int i = 0; i < 2 * MAX_AGE; i++) {
+    op_promote_processes(header);
+  }
+  for(int i = 0; i < 3; i++) {
+    if(waiting[i]->prio_level < MIN_PRIORITY + PRIO_AGE_LEVELS) {
+      abort_error("...Aging only lifted the head of a level.", __FILE__);
+    }
+  }
+
+  op_deallocate(header);
+  print_status("...Prio levels are looking good so far.");
+}
+
+// Counts the processes op_walk_ready visits
+static void count_visit(void *arg, Op_process_s *process) {
+  (*(int *)arg)++;
+}
+
+// Local function to test deadline jobs run earliest deadline first, ahead of every policy
+void test_op_deadline() {
+  Op_schedule_s *header = op_create();
+  Op_process_s *selected = NULL;
+  unsigned long long ms = 1000000ULL;
+  int visited = 0;
+
+  if(header == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+  Op_process_s *bad = op_new_process("bad", 9, 0, 0);
+  if(op_set_deadline(bad, 100 * ms, 200 * ms) != -1) {
+    abort_error("...op_set_deadline took a runtime longer than its deadline.", __FILE__);
+  }
+  op_free_process(bad);
+
+  // Deadlines 5s, 1s and 3s, with a Critical process that would otherwise run first
+  op_add(header, op_new_process("crit", 1, 0, 1));
+  for(int pid = 2; pid <= 4; pid++) {
+    Op_process_s *process = op_new_process("edf", pid, 0, 0);
+    unsigned long long relative[5] = {0, 0, 5000 * ms, 1000 * ms, 3000 * ms};
+    op_set_deadline(process, relative[pid], 100 * ms);
+    op_add(header, process);
+  }
+  op_walk_ready(header, count_visit, &visited);
+  if(visited != 4 || op_get_ready_count(header) != 4) {
+    abort_error("...Deadline jobs are missing from the Ready set.", __FILE__);
+  }
+
+  selected = op_select(header);
+  if(selected == NULL || selected->pid != 3 || op_get_quantum(header, selected) != 1) {
+    abort_error("...The earliest deadline did not run first.", __FILE__);
+  }
+  op_requeue(header, selected, 1);
+  if(op_terminated(header, 3, 9) != 0 || op_find(header, 3) != NULL) {
+    abort_error("...op_terminated failed on a deadline job.", __FILE__);
+  }
+  selected = op_select(header);
+  if(selected == NULL || selected->pid != 4) {
+    abort_error("...EDF order broke after a removal.", __FILE__);
+  }
+  op_exited(header, selected, 0);
+  if(selected->exit_ns > selected->deadline_ns) {
+    abort_error("...A job that finished in time shows as missed.", __FILE__);
+  }
+
+  // A job back from the CPU past its deadline runs with the policy from then on
+  selected = op_select(header);
+  if(selected == NULL || selected->pid != 2) {
+    abort_error("...Deadline jobs did not run before the Critical process.", __FILE__);
+  }
+  selected->deadline_ns = op_now_ns() - 1;
+  op_requeue(header, selected, 1);
+  if(selected->edf != 0 || op_get_count(header->ready_queue_high) != 1) {
+    abort_error("...A missed deadline job kept its place ahead of the policy.", __FILE__);
+  }
+  selected = op_select(header);
+  if(selected == NULL || selected->pid != 1) {
+    abort_error("...A missed deadline job kept its place ahead of the policy.", __FILE__);
+  }
+  op_free_process(selected);
+
+  op_deallocate(header);
+  print_status("...Deadline jobs are looking good so far.");
+}
+
+// Runs quanta slices of two ticket holders (3:1) and a late arrival, returns 1 if A's share of B is in [low, high]
+static int stride_share(Op_policy_s *policy, int quanta, double low, double high) {
+  Op_schedule_s *header = op_create();
+  Op_process_s *selected = NULL;
+  int runs[4] = {0};
+  int ok = 0;
+
+  if(header == NULL || op_set_policy(header, policy) != 0) {
+    abort_error("...Could not set up the ticket policy.", __FILE__);
+  }
+  for(int pid = 1; pid <= 2; pid++) {
+    Op_process_s *process = op_new_process("tickets", pid, 0, 0);
+    op_set_tickets(process, (pid == 1) ? 300 : 100);
+    op_add(header, process);
+  }
+  for(int i = 0; i < quanta; i++) {
+    selected = op_select(header);
+    runs[selected->pid]++;
+    op_requeue(header, selected, 1);
+  }
+  ok = runs[1] >= runs[2] * low && runs[1] <= runs[2] * high;
+
+  // A newcomer with B's tickets gets B's share from here on, not a burst for the time it missed
+  op_add(header, op_new_process("late", 3, 0, 0));
+  runs[2] = 0;
+  for(int i = 0; i < 500; i++) {
+    selected = op_select(header);
+    runs[selected->pid]++;
+    op_requeue(header, selected, 1);
+  }
+  if(runs[3] > 150) {
+    ok = 0;
+  }
+  if(op_terminated(header, 1, 9) != 0 || op_get_ready_count(header) != 2) {
+    ok = 0;
+  }
+  op_deallocate(header);
+  return ok;
+}
+
+// Draws 32 lottery winners among three ticket holders with a seed, returns them packed 2 bits each (pids 1 to 3)
+static unsigned long long lottery_draws(unsigned long long seed) {
+  Op_schedule_s *header = op_create();
+  Op_process_s *selected = NULL;
+  unsigned long long draws = 0;
+
+  op_set_seed(header, seed);
+  if(header == NULL || op_set_policy(header, &op_policy_lottery) != 0) {
+    abort_error("...Could not set up the lottery.", __FILE__);
+  }
+  for(int pid = 1; pid <= 3; pid++) {
+    Op_process_s *process = op_new_process("tickets", pid, 0, 0);
+    op_set_tickets(process, 100 * pid);
+    op_add(header, process);
+  }
+  for(int i = 0; i < 32; i++) {
+    selected = op_select(header);
+    draws = (draws << 2) | selected->pid;
+    op_requeue(header, selected, 1);
+  }
+  op_deallocate(header);
+  return draws;
+}
+
+// Local function to test stride and lottery split CPU quanta in the ratio of tickets
+void test_op_stride() {
+  Op_process_s *bad = op_new_process("bad", 9, 0, 0);
+  if(op_set_tickets(bad, MIN_TICKETS - 1) != -1) {
+    abort_error("...op_set_tickets took an out of range ticket count.", __FILE__);
+  }
+  op_free_process(bad);
+  if(!stride_share(&op_policy_stride, 4000, 2.99, 3.01)) {
+    abort_error("...Stride did not deliver 300:100 tickets as 3:1.", __FILE__);
+  }
+  if(!stride_share(&op_policy_lottery, 100000, 2.85, 3.15)) {
+    abort_error("...Lottery drifted more than 5% from 300:100 tickets.", __FILE__);
+  }
+  // The same seed draws the same winners, whichever schedule runs them
+  if(lottery_draws(7) != lottery_draws(7) || lottery_draws(7) == lottery_draws(8)) {
+    abort_error("...The lottery did not repeat its draws for a seed.", __FILE__);
+  }
+  print_status("...Ticket shares are looking good so far.");
+}
+
+// Local function to test slices are classified CPU-bound or I/O-bound and the quantum scales with it
+void test_op_observe() {
+  Op_schedule_s *header = op_create();
+  Op_process_s *process = op_new_process("observe", 1, 0, 0);
+  unsigned long long ms = 1000000ULL;
+
+  if(process == NULL || process->bound != OP_BOUND_UNKNOWN || op_adapt_quantum(header, process, 1000) != 1000) {
+    abort_error("...A new process did not start unclassified with the full quantum.", __FILE__);
+  }
+  op_observe(process, 250 * ms, 240 * ms);
+  if(process->bound != OP_BOUND_CPU || op_adapt_quantum(header, process, 1000) != 1000 * ADAPT_CPU_PERCENT / 100) {
+    abort_error("...A busy slice did not classify the process CPU-bound.", __FILE__);
+  }
+
+  // One sleepy slice leaves it in between (still CPU-bound), a run of them makes it I/O-bound
+  op_observe(process, 250 * ms, 0);
+  if(process->bound != OP_BOUND_CPU) {
+    abort_error("...One idle slice flipped a CPU-bound process.", __FILE__);
+  }
+  for(int i = 0; i < 4; i++) {
+    op_observe(process, 250 * ms, 1 * ms);
+  }
+  if(process->bound != OP_BOUND_IO || op_adapt_quantum(header, process, 1000) != 1000 * ADAPT_IO_PERCENT / 100) {
+    abort_error("...Sleeping slices did not classify the process I/O-bound.", __FILE__);
+  }
+
+  // A job that starts out half busy is mixed and keeps the plain quantum until it crosses a threshold
+  Op_process_s *mixed = op_new_process("mixed", 2, 0, 0);
+  op_observe(mixed, 250 * ms, 125 * ms);
+  if(mixed->bound != OP_BOUND_MIXED || op_adapt_quantum(header, mixed, 1000) != 1000) {
+    abort_error("...A half busy process did not keep the plain quantum.", __FILE__);
+  }
+  op_free_process(mixed);
+
+  // Stride and lottery count quanta, so theirs must all be the same length
+  if(op_set_policy(header, &op_policy_stride) != 0 || op_adapt_quantum(header, process, 1000) != 1000) {
+    abort_error("...A quantum was scaled under stride scheduling.", __FILE__);
+  }
+  op_set_policy(header, &op_policy_mlfq);
+
+  // Deadline jobs keep the quantum their runtime was budgeted with
+  process->edf = 1;
+  if(op_adapt_quantum(header, process, 1000) != 1000) {
+    abort_error("...A deadline job had its quantum scaled.", __FILE__);
+  }
+  op_free_process(process);
+  op_deallocate(header);
+  print_status("...Behavior classification is looking good so far.");
+}
+
+// Local function to test parked processes leave the Ready set until their recheck time
+void test_op_park() {
+  Op_schedule_s *header = op_create();
+  Op_process_s *sleeper = NULL;
+  Op_process_s *selected = NULL;
+  unsigned long long now = op_now_ns();
+
+  if(header == NULL) {
+    abort_error("...op_create returned NULL!", __FILE__);
+  }
+  for(int pid = 1; pid <= 3; pid++) {
+    op_add(header, op_new_process("park", pid, 0, 0));
+  }
+
+  // 1 is found asleep and parked, 2 runs next and 1 can't be selected until it's due
+  sleeper = op_select(header);
+  if(op_park(header, sleeper, now + 1000000ULL) != 0 || op_get_ready_count(header) != 2 || op_find(header, 1) != NULL) {
+    abort_error("...A parked process is still in the Ready set.", __FILE__);
+  }
+  if(op_unpark(header, now) != 0 || (selected = op_select(header)) == NULL || selected->pid != 2) {
+    abort_error("...A parked process came back before its recheck time.", __FILE__);
+  }
+  op_requeue(header, selected, 1);
+  if(op_unpark(header, now + 1000000ULL) != 1 || op_find(header, 1) != sleeper || sleeper->parks != 1) {
+    abort_error("...A due parked process did not return to the Ready set.", __FILE__);
+  }
+
+  // Terminated or exited while parked, it still ends up Defunct
+  op_park(header, op_select(header), now);
+  if(op_terminated(header, 3, 9) != 0 || op_get_count(header->parked_queue) != 0) {
+    abort_error("...op_terminated did not find a parked process.", __FILE__);
+  }
+  selected = op_select(header);
+  op_park(header, selected, now);
+  if(op_exited(header, selected, 0) != 0 || op_get_count(header->parked_queue) != 0 || op_get_count(header->defunct_queue) != 2) {
+    abort_error("...op_exited did not take a parked process off the Parked Queue.", __FILE__);
+  }
+
+  op_deallocate(header);
+  print_status("...Parking is looking good so far.");
+}
@@ -1,12 +1,17 @@
 
+#define _GNU_SOURCE // sched_setaffinity and the CPU_SET macros
 // System Includes
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
 #include <pthread.h>
 #include <sched.h>
 // Local Includes
@@ -15,114 +20,867 @@
 #include "vm_process.h"
 #include "vm_printing.h"
 #include "op_sched.h"
+#include "vm_trace.h"
+
+// Quantum Timing Statistics (measured SIGCONT->SIGTSTP vs configured quantum)
+typedef struct cs_timing {
+  unsigned long slices;   // Quanta measured
+  unsigned long overruns; // Quanta that ran longer than configured + TIMING_SLACK_USEC
+  double sum_error;       // Sum of (measured - configured) usec
+  double sum_sq_error;    // Sum of squared errors, for jitter
+  long max_overrun;       // Largest (measured - configured) usec
+  long min_error;         // Smallest (measured - configured) usec
+  unsigned long cutoffs;  // Quanta ended early because the process exited or was terminated
+  long reclaimed;         // usec of quantum + between delay handed to the next process instead of idling
+  unsigned long dispatched; // SIGCONTs sent
+  double sum_late;        // Sum of usec each dispatch started after its place on the timeline
+  long max_late;          // Latest dispatch, usec
+} cs_timing_s;
+
+// Latency Histogram (HDR style, log-linear buckets of nanoseconds)
+// Values below 2^HIST_SUB_BITS get a bucket each, above that every power of 2 is split into
+//  2^HIST_SUB_BITS linear buckets, so every bucket is within 1/16 (6.25%) of its values.
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40 // Largest tracked value is 2^40 ns (~18 minutes), bigger ones land in the last bucket
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+typedef struct cs_hist {
+  unsigned long buckets[HIST_BUCKETS]; // Updated with relaxed atomics only
+  unsigned long count;
+  unsigned long long max_ns;
+} cs_hist_s;
+
+// Priority classes each histogram is split by
+enum { CS_CLASS_CRITICAL, CS_CLASS_HIGH, CS_CLASS_LOW, CS_CLASSES };
+static char *cs_class_names[CS_CLASSES] = {"Critical", "High", "Low"};
+
+// Virtual CPU Definition
+typedef struct cs_cpu {
+  int id;                  // Index of this CPU in cs_cpus
+  pthread_t thread;        // Dispatcher thread for this CPU
+  pthread_mutex_t lock;    // Guards schedule and on_cpu (never held while waiting on another CPU)
+  pthread_cond_t exited;   // Signalled (under lock) when on_cpu leaves early, ends the quantum
+  Op_schedule_s *schedule; // Local Run Queue for this CPU
+  Op_inbox_s *inbox;       // New processes handed to this CPU lock-free, drained into schedule under lock
+  Op_process_s *on_cpu;    // Process currently running on this CPU (NULL if idle)
+  int load;                // Ready + Running processes, read without the lock for placement and stealing
+  int parked;              // Processes on the Parked Queue (asleep, not in load), read without the lock
+  unsigned long dispatches; // Quanta run on this CPU
+  unsigned long steals;    // Processes this CPU stole from busier CPUs
+  unsigned long idle_waits; // Times this CPU blocked on cs_cv with nothing to run
+  unsigned long parks;     // Dispatched processes found asleep and parked instead of run
+  int core;                // Host core this CPU owns in affinity mode
+  int llc;                 // Last-Level Cache group of that core (first core sharing it)
+  int pinned;              // 1 if the dispatcher thread is currently pinned to core
+  struct timespec next;    // Absolute CLOCK_MONOTONIC time the next quantum starts
+  cs_timing_s timing;      // Measured quantum statistics (guarded by lock)
+} cs_cpu_s;
+
+// Exit of a process cs_op_terminated couldn't find on any CPU (see cs_record_lost)
+typedef struct cs_lost {
+  pid_t pid;
+  int exit_code;
+} cs_lost_s;
 
 // Globals
-pthread_mutex_t cs_cv_m = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t cs_run_m = PTHREAD_MUTEX_INITIALIZER;
-pthread_t pt_cs; // Main CS thread variable (controlled from atexit function)
-static Op_process_s *on_cpu = NULL;
-static Op_schedule_s *schedule = NULL;
+pthread_cond_t cs_cv;         // Idle CPUs wait here for new work (signalled by cs_place)
+pthread_condattr_t cs_cvattr; // cs_cv times waits against CLOCK_MONOTONIC
+pthread_mutex_t cs_cv_m = PTHREAD_MUTEX_INITIALIZER; // Guards cs_work_seq
+pthread_mutex_t cs_run_m = PTHREAD_MUTEX_INITIALIZER; // Guards cs_run, cs_do_cs and CPU creation
+static pthread_cond_t cs_run_cv = PTHREAD_COND_INITIALIZER; // Stopped or parked CPUs wait here
+static cs_cpu_s cs_cpus[MAX_CPUS];
+static int cs_cpus_started = 0; // CPUs with a dispatcher thread (online or parked)
+static int cs_cpu_count = 0; // CPUs taking work, the rest park (set with set_cpus)
+static Op_mlfq_s cs_mlfq; // Level settings every CPU schedule shares
+static Op_policy_s *cs_policy = NULL; // Scheduling policy every CPU schedule uses (set_policy)
+static unsigned long cs_deadline_ppm = 0; // Admitted deadline utilization, millionths of one CPU (atomic)
+static long cs_deadline_bound = DEADLINE_UTIL_PERCENT; // Percent of each CPU deadline jobs may use
+static int cs_affinity = DEFAULT_AFFINITY; // 1 pins resumed children to their CPU's host core
+static int cs_adapt = DEFAULT_ADAPT; // 1 scales each quantum by the job's CPU-bound/I/O-bound class
+static int cs_probe = DEFAULT_PROBE; // 1 parks dispatched jobs found asleep and runs the next one
+static int cs_host_cores[MAX_CPUS]; // Host cores in LLC order, CPU i owns cs_host_cores[i % cs_host_count]
+static int cs_host_llc[MAX_CPUS];   // LLC group of each entry in cs_host_cores
+static int cs_host_count = 0;
+static int cs_llc_groups = 0;
 static int cs_do_cs = 1; // Controls the lifetime CS Thread
 static int cs_run = 0; // Controls the running of the CS Thread (initialized to STOP)
+static unsigned long cs_work_seq = 0; // Bumped whenever work arrives or the CPUs must re-check their state
 static char g_status_msg[MAX_STATUS] = {0};
-static useconds_t sleep_usec_time = SLEEP_USEC;
-static useconds_t between_usec_time = BETWEEN_USEC;
+static cs_hist_s cs_sched_hist[CS_CLASSES]; // op_add/op_requeue -> SIGCONT (scheduling latency)
+static cs_hist_s cs_gap_hist[CS_CLASSES];   // SIGTSTP -> next SIGCONT of the same job
+static cs_lost_s cs_lost[MAX_PROC]; // Exit codes of processes that exited while moving between CPUs (pid 0 is free)
+static long sleep_usec_time = SLEEP_USEC; // long usec, not useconds_t, so quanta aren't capped at ~71 min
+static long between_usec_time = BETWEEN_USEC;
 
-// Runs at VM startup to initialize context switching thread
-void initialize_cs_system() {
-  // Start the CS Thread Locked by...
-  // 1) Acquiring the lock here on initialization
-  // 2) Each iteration of the CS thread starts by acquiring the lock.
-  // The Shell commands release/acquire the lock to control CS
+// Returns the one letter run state of a process from /proc/<pid>/stat ('?' if unavailable)
+// If core is not NULL it gets the host core the process last ran on (-1 if unavailable).
+static char cs_proc_state(pid_t pid, int *core) {
+  char path[MAX_PATH] = {0};
+  char buf[MAX_STATUS * 2] = {0};
+  char *end_comm = NULL;
+  char *field = NULL;
+  size_t len = 0;
+  FILE *fp = NULL;
+
+  if(core != NULL) {
+    *core = -1;
+  }
+  sprintf(path, "/proc/%d/stat", pid);
+  fp = fopen(path, "r");
+  if(fp == NULL) {
+    return '?';
+  }
+  len = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  buf[len] = '\0';
+
+  // Format is "pid (comm) state ...", comm may itself contain spaces or parentheses
+  end_comm = strrchr(buf, ')');
+  if(end_comm == NULL || end_comm[1] != ' ') {
+    return '?';
+  }
+  // processor is field 39, state is field 3
+  field = end_comm + 2;
+  for(int i = 3; i < 39 && field != NULL; i++) {
+    field = strchr(field, ' ');
+    if(field != NULL) {
+      field++;
+    }
+  }
+  if(core != NULL && field != NULL) {
+    *core = atoi(field);
+  }
+  return end_comm[2];
+}
+
+// Returns the CPU time a process has used in nanoseconds, from /proc/<pid>/schedstat (0 if unavailable)
+static unsigned long long cs_proc_cpu_ns(pid_t pid) {
+  char path[MAX_PATH] = {0};
+  unsigned long long cpu_ns = 0;
+  FILE *fp = NULL;
+
+  sprintf(path, "/proc/%d/schedstat", pid);
+  fp = fopen(path, "r");
+  if(fp == NULL) {
+    return 0;
+  }
+  if(fscanf(fp, "%llu", &cpu_ns) != 1) {
+    cpu_ns = 0;
+  }
+  fclose(fp);
+  return cpu_ns;
+}
+
+// Returns the first core in the Last-Level Cache shared by core (or core itself if sysfs has no cache info)
+static int cs_read_llc(int core) {
+  char path[MAX_PATH] = {0};
+  int best_level = -1;
+  int llc = core;
+  FILE *fp = NULL;
+
+  for(int index = 0; ; index++) {
+    int level = 0;
+    int first = 0;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", core, index);
+    fp = fopen(path, "r");
+    if(fp == NULL) {
+      break;
+    }
+    if(fscanf(fp, "%d", &level) != 1) {
+      level = -1;
+    }
+    fclose(fp);
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", core, index);
+    fp = fopen(path, "r");
+    if(fp == NULL) {
+      continue;
+    }
+    if(level > best_level && fscanf(fp, "%d", &first) == 1) {
+      best_level = level;
+      llc = first;
+    }
+    fclose(fp);
+  }
+  return llc;
+}
+
+// Reads the host cores this VM may use and orders them so neighbouring CPUs share an LLC
+static void cs_read_topology() {
+  cpu_set_t allowed;
+  int count = 0;
+
+  CPU_ZERO(&allowed);
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    CPU_SET(0, &allowed);
+  }
+  for(int core = 0; core < CPU_SETSIZE && count < MAX_CPUS; core++) {
+    if(CPU_ISSET(core, &allowed)) {
+      cs_host_cores[count] = core;
+      cs_host_llc[count] = cs_read_llc(core);
+      count++;
+    }
+  }
+  // Insertion sort by LLC group (stable, so cores stay in order inside a group)
+  for(int i = 1; i < count; i++) {
+    int core = cs_host_cores[i];
+    int llc = cs_host_llc[i];
+    int j = i - 1;
+    while(j >= 0 && cs_host_llc[j] > llc) {
+      cs_host_cores[j + 1] = cs_host_cores[j];
+      cs_host_llc[j + 1] = cs_host_llc[j];
+      j--;
+    }
+    cs_host_cores[j + 1] = core;
+    cs_host_llc[j + 1] = llc;
+  }
+  cs_host_count = count;
+  cs_llc_groups = 0;
+  for(int i = 0; i < count; i++) {
+    if(i == 0 || cs_host_llc[i] != cs_host_llc[i - 1]) {
+      cs_llc_groups++;
+    }
+  }
+}
+
+// Pins a process (or the calling thread with pid 0) to one host core, or any allowed core if core is -1
+static void cs_pin(pid_t pid, int core) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if(core < 0) {
+    for(int i = 0; i < cs_host_count; i++) {
+      CPU_SET(cs_host_cores[i], &set);
+    }
+  }
+  else {
+    CPU_SET(core, &set);
+  }
+  sched_setaffinity(pid, sizeof(set), &set);
+}
+
+// Adds usec microseconds to a timespec
+static void ts_add_usec(struct timespec *ts, long usec) {
+  ts->tv_sec += usec / 1000000;
+  ts->tv_nsec += (usec % 1000000) * 1000;
+  if(ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+// Returns (a - b) in microseconds
+static long ts_diff_usec(struct timespec *a, struct timespec *b) {
+  return (a->tv_sec - b->tv_sec) * 1000000 + (a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+// Sleeps until an absolute CLOCK_MONOTONIC deadline (no drift from time spent before the call)
+static void cs_sleep_until(struct timespec *deadline) {
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR) {
+    // Interrupted by a signal, keep sleeping to the same deadline
+  }
+}
+
+// Runs on_cpu until the deadline, or until it exits (call with cpu->lock held, returns with it held).
+// Returns 1 if the quantum was cut short because the process left the CPU.
+static int cs_run_quantum(cs_cpu_s *cpu, struct timespec *deadline) {
+  Op_process_s *proc = cpu->on_cpu;
+  while(cpu->on_cpu == proc) {
+    if(pthread_cond_timedwait(&cpu->exited, &cpu->lock, deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  return cpu->on_cpu != proc;
+}
+
+// Records one measured quantum (call with cpu->lock held)
+static void cs_record_timing(cs_cpu_s *cpu, long measured, long configured) {
+  long error = measured - configured;
+  cs_timing_s *t = &cpu->timing;
+  if(t->slices == 0 || error < t->min_error) {
+    t->min_error = error;
+  }
+  if(t->slices == 0 || error > t->max_overrun) {
+    t->max_overrun = error;
+  }
+  if(error > TIMING_SLACK_USEC) {
+    t->overruns++;
+  }
+  t->slices++;
+  t->sum_error += error;
+  t->sum_sq_error += (double)error * error;
+}
+
+// Takes a CPU's lock from the shell thread.  SIGCHLD stays blocked until cs_shell_unlock:
+// its handler calls cs_op_terminated, which takes CPU locks and would self-deadlock on this thread.
+static void cs_shell_lock(cs_cpu_s *cpu, sigset_t *old_mask) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  pthread_sigmask(SIG_BLOCK, &mask, old_mask);
+  pthread_mutex_lock(&cpu->lock);
+}
+
+// Releases a lock taken with cs_shell_lock and restores the signal mask
+static void cs_shell_unlock(cs_cpu_s *cpu, sigset_t *old_mask) {
+  pthread_mutex_unlock(&cpu->lock);
+  pthread_sigmask(SIG_SETMASK, old_mask, NULL);
+}
+
+// Returns the histogram bucket for a value in nanoseconds
+static int cs_hist_bucket(unsigned long long value) {
+  int msb = 0;
+  if(value < HIST_SUB_COUNT) {
+    return (int)value;
+  }
+  msb = 63 - __builtin_clzll(value);
+  if(msb >= HIST_MAX_BITS) {
+    return HIST_BUCKETS - 1;
+  }
+  // The top HIST_SUB_BITS bits below the msb pick the linear sub-bucket
+  return (msb - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + (int)((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+// Returns the largest value (ns) that lands in a bucket
+static unsigned long long cs_hist_bucket_top(int bucket) {
+  int tier = bucket / HIST_SUB_COUNT;
+  int sub = bucket % HIST_SUB_COUNT;
+  if(tier == 0) {
+    return (unsigned long long)bucket;
+  }
+  int msb = tier + HIST_SUB_BITS - 1;
+  return ((unsigned long long)(HIST_SUB_COUNT + sub + 1) << (msb - HIST_SUB_BITS)) - 1;
+}
+
+// Records one value (ns).  Lock-free and allocation-free, safe on the dispatch path.
+static void cs_hist_record(cs_hist_s *hist, unsigned long long value) {
+  unsigned long long max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->buckets[cs_hist_bucket(value)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+  while(value > max && !__atomic_compare_exchange_n(&hist->max_ns, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    // max was reloaded by the failed CAS, try again while still larger
+  }
+}
+
+// Returns the priority class a selected process is histogrammed under
+static int cs_class(Op_schedule_s *schedule, Op_process_s *proc) {
+  if((proc->state >> 31) & 1) {
+    return CS_CLASS_CRITICAL;
+  }
+  return (proc->level == schedule->mlfq.levels - 1) ? CS_CLASS_LOW : CS_CLASS_HIGH;
+}
+
+// Scheduler trace hook for each CPU's schedule (see op_set_trace)
+static void cs_trace_hook(void *arg, int event, Op_process_s *proc) {
+  trace_record(event, ((cs_cpu_s *)arg)->id, proc->pid, op_trace_queue(proc));
+}
+
+// Records the exit code of a process cs_op_terminated couldn't find (in an inbox or moving between CPUs).
+// Only the SIGCHLD handler writes, each slot is published by storing its pid last.
+static void cs_record_lost(pid_t pid, int exit_code) {
+  for(int i = 0; i < MAX_PROC; i++) {
+    if(__atomic_load_n(&cs_lost[i].pid, __ATOMIC_ACQUIRE) == 0) {
+      cs_lost[i].exit_code = exit_code;
+      __atomic_store_n(&cs_lost[i].pid, pid, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+  print_warning("Lost exit table is full, a process that exited between CPUs will keep running in the schedule.");
+}
+
+// Takes the recorded exit code for pid, if it exited while moving between CPUs.
+// Returns 1 (and sets exit_code) if there was one, 0 if not.
+static int cs_take_lost(pid_t pid, int *exit_code) {
+  for(int i = 0; i < MAX_PROC; i++) {
+    if(__atomic_load_n(&cs_lost[i].pid, __ATOMIC_ACQUIRE) == pid) {
+      *exit_code = cs_lost[i].exit_code;
+      __atomic_store_n(&cs_lost[i].pid, 0, __ATOMIC_RELEASE);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Wakes every idle CPU so it re-checks for work (new process, steal target, stop, shutdown)
+static void cs_kick_idle() {
   pthread_mutex_lock(&cs_cv_m);
+  cs_work_seq++;
+  pthread_cond_broadcast(&cs_cv);
+  pthread_mutex_unlock(&cs_cv_m);
+}
 
-  int ret = pthread_create(&pt_cs, NULL, &cs_thread, NULL);
-  if(ret != 0) {
-    abort_error("Could not create a Thread for the CS System.", __FILE__);
+// Blocks an idle CPU until cs_work_seq moves past seen (no timed polling while idle)
+// If until is not NULL it also wakes then (the next parked process is due back).
+static void cs_wait_idle(cs_cpu_s *cpu, unsigned long seen, struct timespec *until) {
+  pthread_mutex_lock(&cs_cv_m);
+  if(cs_work_seq == seen) {
+    cpu->idle_waits++;
   }
-  // Initialize the Scheduler System (this is designed as a part of CS)
-  schedule = op_create();
-  if(schedule == NULL) {
+  while(cs_work_seq == seen) {
+    if(until == NULL) {
+      pthread_cond_wait(&cs_cv, &cs_cv_m);
+    }
+    else if(pthread_cond_timedwait(&cs_cv, &cs_cv_m, until) == ETIMEDOUT) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&cs_cv_m);
+}
+
+// Moves up to max submitted processes into the Run Queue (call with cpu->lock held, it makes us the consumer)
+static int cs_drain(cs_cpu_s *cpu, int max) {
+  return op_inbox_drain(cpu->inbox, cpu->schedule, max);
+}
+
+// Refreshes the placement load of a CPU (call with cpu->lock held)
+// Only runnable processes count: parked ones can't be stolen and don't compete for the CPU.
+static void cs_update_load(cs_cpu_s *cpu) {
+  int load = op_get_ready_count(cpu->schedule) + op_inbox_count(cpu->inbox) + (cpu->on_cpu ? 1 : 0);
+  __atomic_store_n(&cpu->load, load, __ATOMIC_RELAXED);
+  __atomic_store_n(&cpu->parked, op_get_count(cpu->schedule->parked_queue), __ATOMIC_RELAXED);
+}
+
+// Returns the online CPU with the fewest Ready + Running processes
+static cs_cpu_s *cs_least_loaded() {
+  int count = __atomic_load_n(&cs_cpu_count, __ATOMIC_ACQUIRE);
+  cs_cpu_s *best = &cs_cpus[0];
+  for(int i = 1; i < count; i++) {
+    if(__atomic_load_n(&cs_cpus[i].load, __ATOMIC_RELAXED) < __atomic_load_n(&best->load, __ATOMIC_RELAXED)) {
+      best = &cs_cpus[i];
+    }
+  }
+  return best;
+}
+
+// Share of one CPU (millionths) a deadline job asks for
+static unsigned long cs_deadline_util(long runtime_usec, long deadline_usec) {
+  return (unsigned long)(runtime_usec * 1000000.0 / deadline_usec);
+}
+
+// Gives back the utilization a deadline job was admitted with, once it has gone Defunct
+static void cs_release_deadline(Op_process_s *proc) {
+  if(proc != NULL && proc->deadline_ns != 0) {
+    __atomic_sub_fetch(&cs_deadline_ppm, cs_deadline_util(proc->runtime_ns / 1000, proc->relative_ns / 1000), __ATOMIC_RELAXED);
+  }
+}
+
+// Hands a process to the least loaded online CPU through its lock-free inbox.
+// The CPU's lock is only taken if the inbox is full, so submitters never stall a dispatch.
+static cs_cpu_s *cs_place(Op_process_s *proc) {
+  cs_cpu_s *cpu = cs_least_loaded();
+  if(op_inbox_push(cpu->inbox, proc) == 0) {
+    __atomic_add_fetch(&cpu->load, 1, __ATOMIC_RELAXED);
+  }
+  else {
+    pthread_mutex_lock(&cpu->lock);
+    cs_drain(cpu, 0);
+    op_add(cpu->schedule, proc);
+    cs_update_load(cpu);
+    pthread_mutex_unlock(&cpu->lock);
+  }
+  cs_kick_idle();
+  return cpu;
+}
+
+// Idle CPU takes the next process from the busiest CPU that has one waiting.
+// Only one CPU lock is ever held at a time, so stealing can't deadlock.
+static Op_process_s *cs_steal(cs_cpu_s *cpu) {
+  int count = __atomic_load_n(&cs_cpu_count, __ATOMIC_ACQUIRE);
+  cs_cpu_s *victim = NULL;
+  Op_process_s *proc = NULL;
+
+  int victim_load = 1; // A CPU with just one process is only running it, nothing to steal
+  int victim_near = 0;
+
+  // Busiest CPU wins, but in affinity mode one sharing our LLC beats any that doesn't (warm cache)
+  for(int i = 0; i < count; i++) {
+    int load = __atomic_load_n(&cs_cpus[i].load, __ATOMIC_RELAXED);
+    int near = cs_affinity && cs_cpus[i].llc == cpu->llc;
+    if(i != cpu->id && load > 1 && (near > victim_near || (near == victim_near && load > victim_load))) {
+      victim = &cs_cpus[i];
+      victim_load = load;
+      victim_near = near;
+    }
+  }
+  if(victim == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&victim->lock);
+  cs_drain(victim, INBOX_DRAIN_BATCH);
+  proc = op_select(victim->schedule);
+  cs_update_load(victim);
+  pthread_mutex_unlock(&victim->lock);
+
+  if(proc != NULL) {
+    cpu->steals++;
+  }
+  return proc;
+}
+
+// Moves every Ready process off a CPU that is going offline
+static void cs_migrate_all(cs_cpu_s *cpu) {
+  Op_process_s *proc = NULL;
+  do {
+    pthread_mutex_lock(&cpu->lock);
+    cs_drain(cpu, 0);
+    op_unpark(cpu->schedule, ~0ULL); // Parked ones move too, they're rechecked on their new CPU
+    proc = op_select(cpu->schedule);
+    cs_update_load(cpu);
+    pthread_mutex_unlock(&cpu->lock);
+    if(proc != NULL) {
+      cs_place(proc);
+    }
+  } while(proc != NULL);
+}
+
+// Blocks a dispatcher while the CS System is stopped or its CPU is offline
+static void cs_wait_for_work(cs_cpu_s *cpu) {
+  // Fast path: running and online, no lock taken
+  if(__atomic_load_n(&cs_run, __ATOMIC_ACQUIRE) && cpu->id < __atomic_load_n(&cs_cpu_count, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  pthread_mutex_lock(&cs_run_m);
+  while(cs_do_cs && (cs_run == 0 || cpu->id >= cs_cpu_count)) {
+    if(cpu->id >= cs_cpu_count && (__atomic_load_n(&cpu->load, __ATOMIC_RELAXED) > 0 || __atomic_load_n(&cpu->parked, __ATOMIC_RELAXED) > 0)) {
+      pthread_mutex_unlock(&cs_run_m);
+      cs_migrate_all(cpu);
+      pthread_mutex_lock(&cs_run_m);
+      continue;
+    }
+    pthread_cond_wait(&cs_run_cv, &cs_run_m);
+  }
+  pthread_mutex_unlock(&cs_run_m);
+}
+
+// Checks a process PARK_PROBE_USEC into its quantum (call with cpu->lock held, proc on the CPU).
+// If it's asleep ('S' or 'D') and has used under half of that time, it is stopped and parked
+//  until PARK_RECHECK_USEC from now instead of holding the CPU through a quantum it can't use.
+// Returns 1 if it was parked (the CPU is free), 0 if it keeps running.
+static int cs_probe_park(cs_cpu_s *cpu, Op_process_s *proc, struct timespec *resumed) {
+  char msg[MAX_STATUS] = {0};
+  struct timespec now;
+  unsigned long long cpu_ns = 0, used = 0;
+  long ran = 0;
+  char state = cs_proc_state(proc->pid, NULL);
+
+  if(state != 'S' && state != 'D') {
+    return 0;
+  }
+  cpu_ns = cs_proc_cpu_ns(proc->pid);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ran = ts_diff_usec(&now, resumed);
+  used = (cpu_ns > proc->cpu_ns) ? cpu_ns - proc->cpu_ns : 0;
+  if(cpu_ns == 0 || used * 2 > (unsigned long long)ran * 1000) {
+    return 0; // Busy most of the probe, just blocked for a moment
+  }
+
+  kill(proc->pid, SIGTSTP);
+  trace_record(OP_EV_SUSPEND, cpu->id, proc->pid, op_trace_queue(proc));
+  proc->stop_ns = op_now_ns();
+  op_observe(proc, (unsigned long long)ran * 1000, used);
+  proc->cpu_ns = cpu_ns;
+  op_park(cpu->schedule, proc, proc->stop_ns + PARK_RECHECK_USEC * 1000ULL);
+  cpu->on_cpu = NULL;
+  cpu->parks++;
+  sprintf(msg, "CPU %d PID %d was asleep %ld usec into its quantum, parked", cpu->id, proc->pid, ran);
+  print_debug(msg);
+  return 1;
+}
+
+// Creates the schedule and dispatcher thread for the next CPU (call with cs_run_m held)
+static void cs_start_cpu() {
+  cs_cpu_s *cpu = &cs_cpus[cs_cpus_started];
+  sigset_t mask, old_mask;
+
+  cpu->id = cs_cpus_started;
+  cpu->on_cpu = NULL;
+  cpu->load = 0;
+  cpu->parked = 0;
+  cpu->dispatches = 0;
+  cpu->steals = 0;
+  cpu->idle_waits = 0;
+  cpu->parks = 0;
+  cpu->core = cs_host_cores[cpu->id % cs_host_count];
+  cpu->llc = cs_host_llc[cpu->id % cs_host_count];
+  cpu->pinned = 0;
+  memset(&cpu->timing, 0, sizeof(cpu->timing));
+  clock_gettime(CLOCK_MONOTONIC, &cpu->next);
+  pthread_mutex_init(&cpu->lock, NULL);
+  pthread_cond_init(&cpu->exited, &cs_cvattr);
+  cpu->schedule = op_create();
+  if(cpu->schedule == NULL) {
     abort_error("Failed to initialize the Scheduler System (op_create returned NULL).", __FILE__);
   }
+  op_set_mlfq(cpu->schedule, &cs_mlfq);
+  if(op_set_policy(cpu->schedule, cs_policy) != 0) {
+    abort_error("Failed to set up the Scheduling Policy for a CPU.", __FILE__);
+  }
+  op_set_trace(cpu->schedule, cs_trace_hook, cpu);
+  cpu->inbox = malloc(sizeof(Op_inbox_s));
+  if(cpu->inbox == NULL) {
+    abort_error("Failed to allocate the submission inbox for a CPU.", __FILE__);
+  }
+  op_inbox_init(cpu->inbox);
+
+  // SIGCHLD and SIGINT are only handled on the shell thread, never inside a dispatcher holding a CPU lock.
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+  int ret = pthread_create(&cpu->thread, NULL, &cs_thread, cpu);
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  if(ret != 0) {
+    abort_error("Could not create a Thread for the CS System.", __FILE__);
+  }
+  cs_cpus_started++;
+}
+
+// Runs at VM startup to initialize context switching thread
+void initialize_cs_system() {
+  // The CS Threads start STOPPED (cs_run is 0), each waits on cs_run_cv.
+  // The Shell commands start/stop them with start_cs/stop_cs.
+  // Initialize the Scheduler System (this is designed as a part of CS), one per CPU
+  // Idle CPUs block on cs_cv; CLOCK_MONOTONIC keeps any timed waits on the dispatch timeline
+  pthread_condattr_init(&cs_cvattr);
+  pthread_condattr_setclock(&cs_cvattr, CLOCK_MONOTONIC);
+  pthread_cond_init(&cs_cv, &cs_cvattr);
+  op_mlfq_classic(&cs_mlfq);
+  cs_policy = op_policies[0];
+  cs_read_topology();
+  set_cpus(NUM_CPUS);
 }
 
 // Called on an atexit to free all CS related memory.
 void cs_cleanup() {
   print_status("... Beginning CS Shutdown");
+  print_status("... Shutting Down CS System and Dispatchers");
+  pthread_mutex_lock(&cs_run_m);
+  cs_do_cs = 0; // Tell the threads to die.
+  pthread_cond_broadcast(&cs_run_cv); // If the CS is not running, activate it so it can die.
+  pthread_mutex_unlock(&cs_run_m);
+  cs_kick_idle(); // Idle CPUs are waiting for work, wake them so they can die too.
+  for(int i = 0; i < cs_cpus_started; i++) {
+    pthread_join(cs_cpus[i].thread, NULL);
+  }
+  pthread_cond_destroy(&cs_cv);
+  pthread_condattr_destroy(&cs_cvattr);
   print_status("... Deallocating Scheduler");
-  op_deallocate(schedule);
-  print_status("... Shutting Down CS System and Dispatcher");
-  cs_do_cs = 0; // Tell the thread to die.
-  pthread_mutex_unlock(&cs_cv_m); // If the CS is not running, activate it so it can die.
-  pthread_join(pt_cs, NULL);
-  print_status("... Removing Process from CPU");
-  free(on_cpu);
-  on_cpu = NULL; // Nothing on CPU.
+  print_status("... Removing Processes from CPUs");
+  for(int i = 0; i < cs_cpus_started; i++) {
+    pthread_cond_destroy(&cs_cpus[i].exited);
+    cs_drain(&cs_cpus[i], 0); // Anything still in flight is freed with the schedule
+    free(cs_cpus[i].inbox);
+    op_deallocate(cs_cpus[i].schedule);
+    op_free_process(cs_cpus[i].on_cpu);
+    cs_cpus[i].on_cpu = NULL; // Nothing on CPU.
+  }
+  op_pool_release();
   print_status("... CS Shutdown Complete");
 }
 
-// Context Switching Thread
+// Context Switching Thread (one per virtual CPU)
 void *cs_thread(void *args) {
+  cs_cpu_s *cpu = (cs_cpu_s *)args;
+  char msg[MAX_STATUS] = {0};
   int iteration = 1;
-// 1) While not blocked... (lock cs_cv_m to block)
-// .. a) Gets the next process to run from the Scheduler (select)
-// .. .. Holds this in the on_cpu global
+  Op_process_s *proc = NULL;
+  pid_t pid = 0;
+// 1) While running and online... (stop_cs or set_cpus to block)
+// .. a) Gets the next process to run from this CPU's Scheduler (select)
+// .. .. Steals one from the busiest CPU if the local Run Queue is empty
+// .. .. Holds this in cpu->on_cpu
 // .. b) Resumes the selected process
-// .. c) Sleeps for sleep_usec_time microseconds
+// .. c) Sleeps until the quantum's absolute deadline (cpu->next + sleep_usec_time)
 // .. d) Suspends the selected process
 // .. e) Returns the process to the Scheduler (insert)
-  while(cs_do_cs) {
-    long delay = sleep_usec_time;
-    pthread_mutex_lock(&cs_cv_m);  // mylock.acquire()  -- Turnstile Pattern
-    pthread_mutex_unlock(&cs_cv_m);// mylock.release()
-    // Check to see if the system is being shutdown while waiting on lock.
-    if(cs_do_cs == 0) {
+// .. f) If nothing was selected, blocks on cs_cv until cs_place (or stop/shutdown) signals it
+// Deadlines are absolute CLOCK_MONOTONIC times, so select/promote/debug overhead is
+//  absorbed instead of adding drift to every cycle.
+  while(__atomic_load_n(&cs_do_cs, __ATOMIC_ACQUIRE)) {
+    long delay = 0;
+    unsigned long long recheck_ns = 0; // When the next parked process is due back (0 if none)
+    struct timespec deadline, now, resumed, probe;
+    struct timespec due = cpu->next; // When this dispatch should happen, if nothing holds us up
+    unsigned long seen = 0;
+    cs_wait_for_work(cpu);
+    // Check to see if the system is being shutdown while waiting.
+    if(__atomic_load_n(&cs_do_cs, __ATOMIC_ACQUIRE) == 0) {
       continue; 
     }
-    sprintf(g_status_msg, "Context Switch: Iteration %d", iteration++);
-    print_debug(g_status_msg);
+    delay = sleep_usec_time; // Read after waiting, runtime may have changed while stopped
+    // Start a fresh timeline if we fell more than a quantum behind (eg. after a stop)
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(ts_diff_usec(&now, &cpu->next) > delay) {
+      cpu->next = now;
+    }
+    sprintf(msg, "CPU %d Context Switch: Iteration %d", cpu->id, iteration++);
+    print_debug(msg);
+    // The dispatcher follows the affinity mode too, so it shares its core with the children it runs
+    int affinity = __atomic_load_n(&cs_affinity, __ATOMIC_RELAXED);
+    if(cpu->pinned != affinity) {
+      cs_pin(0, affinity ? cpu->core : -1);
+      cpu->pinned = affinity;
+    }
 
-    // Call the Scheduler to get the next Process
-    on_cpu = op_select_high(schedule);
-    if(!on_cpu) {
-      on_cpu = op_select_low(schedule);
-      if(on_cpu) {
-        delay *= 2;
+    // Any work that arrives after this point bumps cs_work_seq, so an idle wait can't miss it
+    seen = __atomic_load_n(&cs_work_seq, __ATOMIC_ACQUIRE);
+    // Pull new submissions in (bounded batch), then call the Scheduler to get the next Process and manage Promotions
+    pthread_mutex_lock(&cpu->lock);
+    cs_drain(cpu, INBOX_DRAIN_BATCH);
+    op_unpark(cpu->schedule, op_now_ns());
+    proc = op_select(cpu->schedule);
+    op_promote_processes(cpu->schedule);
+    if(cpu->schedule->parked_queue->head != NULL) {
+      recheck_ns = cpu->schedule->parked_queue->head->recheck_ns;
+    }
+    // A local pick goes straight to on_cpu under the same lock, so cs_op_terminated always finds it.
+    // Stealing takes the victim's lock, so ours is dropped for it and a stolen job is briefly in no schedule.
+    if(proc == NULL) {
+      pthread_mutex_unlock(&cpu->lock);
+      proc = cs_steal(cpu);
+      pthread_mutex_lock(&cpu->lock);
+    }
+    cpu->on_cpu = proc;
+    // Exited while it was in an inbox or moving between CPUs, cs_op_terminated left its exit code behind
+    int lost_code = 0;
+    if(proc != NULL && cs_take_lost(proc->pid, &lost_code)) {
+      op_exited(cpu->schedule, proc, lost_code);
+      cs_release_deadline(proc);
+      cpu->on_cpu = proc = NULL;
+    }
+    if(proc != NULL) {
+      unsigned long long now_ns = op_now_ns();
+      int class = cs_class(cpu->schedule, proc);
+      proc->quanta++;
+      if(proc->first_run_ns == 0) {
+        proc->first_run_ns = now_ns;
+      }
+      cs_hist_record(&cs_sched_hist[class], now_ns - proc->ready_ns);
+      if(proc->stop_ns != 0) {
+        cs_hist_record(&cs_gap_hist[class], now_ns - proc->stop_ns);
       }
     }
-
-    // Call the Scheduler to manage Promotions
-    op_promote_processes(schedule);
+    cs_update_load(cpu);
+    pthread_mutex_unlock(&cpu->lock);
 
     // Only Dispatch if something was selected
-    if(on_cpu != NULL) {
-      if(process_find(on_cpu->pid) == 0) {
-        op_exited(schedule, on_cpu, 42);
-        on_cpu = NULL;
+    if(proc != NULL) {
+      // Each level has its own quantum (classic Low Priority runs twice as long)
+      delay *= op_get_quantum(cpu->schedule, proc);
+      // I/O-bound jobs get a short slice (they'd sleep through a long one), CPU-bound ones a longer one
+      if(__atomic_load_n(&cs_adapt, __ATOMIC_RELAXED)) {
+        delay = op_adapt_quantum(cpu->schedule, proc, delay);
       }
-      else {
-        // If this was pulled from the long-scheduler, run twice as long.
-        sprintf(g_status_msg, "Schedule Select Returned PID %d", on_cpu->pid);
-        print_debug(g_status_msg);
-        kill(on_cpu->pid, SIGCONT);
-        usleep(delay);
-        // Process may have exited and already been cleaned up.  Check if still exists first.
-        if(on_cpu) {
-          kill(on_cpu->pid, SIGTSTP);
-          op_add(schedule, on_cpu);
-          on_cpu = NULL;
+      pid = proc->pid;
+      sprintf(msg, "CPU %d Schedule Select Returned PID %d (Level %d, %ld usec)", cpu->id, pid, proc->level, delay);
+      print_debug(msg);
+      cpu->dispatches++;
+      if(affinity) {
+        cs_pin(pid, cpu->core);
+        proc->pinned = 1;
+      }
+      else if(proc->pinned) { // Pinned before affinity was turned off, let Linux place it again
+        cs_pin(pid, -1);
+        proc->pinned = 0;
+      }
+      deadline = cpu->next;
+      ts_add_usec(&deadline, delay);
+      pthread_mutex_lock(&cpu->lock);
+      // Exited while the lock was down (cs_exiting_process already retired it), so there's nothing to resume
+      if(cpu->on_cpu != proc) {
+        clock_gettime(CLOCK_MONOTONIC, &cpu->next);
+        cs_update_load(cpu);
+        pthread_mutex_unlock(&cpu->lock);
+        sprintf(msg, "CPU %d PID %d exited before it was resumed, selecting again", cpu->id, pid);
+        print_debug(msg);
+        continue;
+      }
+      clock_gettime(CLOCK_MONOTONIC, &resumed);
+      kill(pid, SIGCONT);
+      trace_record(OP_EV_RESUME, cpu->id, pid, op_trace_queue(proc));
+      long late = ts_diff_usec(&resumed, &due);
+      late = (late < 0) ? 0 : late;
+      cpu->timing.dispatched++;
+      cpu->timing.sum_late += late;
+      if(late > cpu->timing.max_late) {
+        cpu->timing.max_late = late;
+      }
+      // Long enough quanta are probed first: a job already asleep is parked and the next one runs now
+      int left = 0;
+      if(__atomic_load_n(&cs_probe, __ATOMIC_RELAXED) && delay >= 2 * PARK_PROBE_USEC) {
+        probe = resumed;
+        ts_add_usec(&probe, PARK_PROBE_USEC);
+        left = cs_run_quantum(cpu, &probe);
+        if(!left && cpu->on_cpu == proc && cs_probe_park(cpu, proc, &resumed)) {
+          clock_gettime(CLOCK_MONOTONIC, &cpu->next);
+          cs_update_load(cpu);
+          pthread_mutex_unlock(&cpu->lock);
+          continue;
+        }
+      }
+      // Wakes early if the process exits or is terminated (cs_exiting_process signals cpu->exited)
+      if(left || cs_run_quantum(cpu, &deadline)) {
+        // Hand the rest of the quantum and the between delay straight to the next process
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long reclaimed = ts_diff_usec(&deadline, &now) + between_usec_time;
+        // Already reaped, so /proc is gone: charge the final partial quantum at wall time
+        proc->cpu_ns += (unsigned long long)ts_diff_usec(&now, &resumed) * 1000;
+        cpu->timing.cutoffs++;
+        cpu->timing.reclaimed += reclaimed;
+        cpu->next = now;
+        cs_update_load(cpu);
+        pthread_mutex_unlock(&cpu->lock);
+        sprintf(msg, "CPU %d PID %d left the CPU early, reclaimed %ld usec", cpu->id, pid, reclaimed);
+        print_debug(msg);
+        continue;
+      }
+      // Still on the CPU at the deadline, preempt it.
+      if(cpu->on_cpu) {
+        // Still running at preemption = used its whole quantum, otherwise it yielded early (MLFQ demotion)
+        int core = -1;
+        int used_quantum = (cs_proc_state(pid, &core) == 'R');
+        unsigned long long cpu_ns = cs_proc_cpu_ns(pid);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        // Stopped between slices, so everything schedstat gained since the last sample was this slice
+        if(cpu_ns > 0) {
+          op_observe(proc, (unsigned long long)ts_diff_usec(&now, &resumed) * 1000, (cpu_ns > proc->cpu_ns) ? cpu_ns - proc->cpu_ns : 0);
+        }
+        if(cpu_ns > proc->cpu_ns) {
+          proc->cpu_ns = cpu_ns;
+        }
+        if(core >= 0) {
+          if(proc->last_core >= 0 && proc->last_core != core) {
+            proc->migrations++;
+          }
+          proc->last_core = core;
         }
+        kill(pid, SIGTSTP);
+        trace_record(OP_EV_SUSPEND, cpu->id, pid, op_trace_queue(proc));
+        proc->stop_ns = op_now_ns();
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        cs_record_timing(cpu, ts_diff_usec(&now, &resumed), delay);
+        sprintf(msg, "CPU %d PID %d ran %ld usec of a %ld usec quantum", cpu->id, pid, ts_diff_usec(&now, &resumed), delay);
+        print_debug(msg);
+        op_requeue(cpu->schedule, cpu->on_cpu, used_quantum);
+        cpu->on_cpu = NULL;
       }
+      cs_update_load(cpu);
+      pthread_mutex_unlock(&cpu->lock);
     }
     // Nothing selected, IDLE CPU
     else {
-      print_debug("Schedule Select Returned Nothing");
-      usleep(delay);
-      // Unnecessary with the sleep... sched_yield(); // Tells Linux to switch threads
+      sprintf(msg, "CPU %d Schedule Select Returned Nothing, waiting for work", cpu->id);
+      print_debug(msg);
+      // Parked processes come back on their own time, so don't sleep past the first one
+      struct timespec until = {(time_t)(recheck_ns / 1000000000ULL), (long)(recheck_ns % 1000000000ULL)};
+      cs_wait_idle(cpu, seen, recheck_ns ? &until : NULL);
+      // New work runs right away, on a fresh timeline
+      clock_gettime(CLOCK_MONOTONIC, &cpu->next);
+      continue;
     }
     // Delay after the run quantum, but before we pick a new one (to help with debugging)
-    usleep(between_usec_time);
+    cpu->next = deadline;
+    ts_add_usec(&cpu->next, between_usec_time);
+    cs_sleep_until(&cpu->next);
   }
   pthread_exit(0);
 }
@@ -166,65 +924,212 @@ void cs_resume(pid_t pid) {
   }
 }
 */
-// Returns the process that was on the CPU back to the Scheduler
-void cs_exiting_process(int exit_code) {
-  if(on_cpu) {
-    op_exited(schedule, on_cpu, exit_code);
-    sprintf(g_status_msg, "Exiting PID %d, with exit code %d with op_exited\n", on_cpu->pid, exit_code);
-    print_debug(g_status_msg);
-    on_cpu = NULL;
+// Returns the process that was on the CPU back to the Scheduler (call with cpu->lock held)
+static void cs_exiting_process(cs_cpu_s *cpu, int exit_code) {
+  char msg[MAX_STATUS] = {0}; // Not g_status_msg, this runs inside the SIGCHLD handler
+  if(cpu->on_cpu) {
+    op_exited(cpu->schedule, cpu->on_cpu, exit_code);
+    cs_release_deadline(cpu->on_cpu);
+    sprintf(msg, "Exiting PID %d on CPU %d, with exit code %d with op_exited\n", cpu->on_cpu->pid, cpu->id, exit_code);
+    print_debug(msg);
+    cpu->on_cpu = NULL;
+    cs_update_load(cpu);
+    pthread_cond_signal(&cpu->exited); // Cut the quantum short, the dispatcher moves on right away
   }
   else {
     print_warning("Tried to exit a non-existing process on the CPU");
   }
 }
 
-// Adds the newly created process to the schedule system
+// Adds the newly created process to the schedule system (least loaded CPU)
 void cs_op_process(process_data_t *proc) {
   Op_process_s *proc_node = op_new_process(proc->cmd, proc->pid, proc->is_low, proc->is_critical);
-  op_add(schedule, proc_node);
-  print_op_debug(schedule);
+  cs_cpu_s *cpu = NULL;
+  if(proc_node == NULL) {
+    print_warning("Could not allocate a Scheduler node for the new process.");
+    if(proc->deadline_usec > 0) {
+      __atomic_sub_fetch(&cs_deadline_ppm, cs_deadline_util(proc->runtime_usec, proc->deadline_usec), __ATOMIC_RELAXED);
+    }
+    return;
+  }
+  op_set_priority(proc_node, proc->priority);
+  op_set_tickets(proc_node, proc->tickets);
+  if(proc->deadline_usec > 0 && op_set_deadline(proc_node, proc->deadline_usec * 1000ULL, proc->runtime_usec * 1000ULL) != 0) {
+    print_warning("Invalid deadline, running it as a normal process.");
+    __atomic_sub_fetch(&cs_deadline_ppm, cs_deadline_util(proc->runtime_usec, proc->deadline_usec), __ATOMIC_RELAXED);
+  }
+  cpu = cs_place(proc_node);
+  // Only debug output needs the CPU's lock, submission itself never takes it
+  if(debug_mode) {
+    sigset_t old_mask;
+    cs_shell_lock(cpu, &old_mask);
+    cs_drain(cpu, 0);
+    print_op_debug(cpu->schedule);
+    cs_shell_unlock(cpu, &old_mask);
+  }
 }
 
-// Tells the schedule to terminate the process with the given exit code
+// Tells the schedule to terminate the process with the given exit code.
+// Each CPU's lock guards its own schedule and on_cpu, so this never pauses the CS System.
+// Runs from the SIGCHLD handler, so it only takes CPU locks (see cs_shell_lock) and never drains
+//  an inbox (op_add can allocate).  A process still waiting in an inbox is left to the lost exit table.
 void cs_op_terminated(pid_t pid, int exit_code) {
-  int last_state = -1;
+  char msg[MAX_STATUS] = {0};
+  int found = 0;
 
-  // There IS a race condition here, but it's a pretty minor one.  
-  // If it WAS running when we shut it off, restart it when we finish.
-  // It's possible they shut it off manually in the microseconds between these,
-  // but it's not exactly the end of the world if they had.
-  pthread_mutex_lock(&cs_run_m);
-  last_state = cs_run;
-  pthread_mutex_unlock(&cs_run_m);
-  stop_cs(); // Critical! This ensures the state is consistent first.
-  if(on_cpu && on_cpu->pid == pid) {
-    // Exit from the CPU directly (terminated while being run)
-    cs_exiting_process(exit_code);
-  }
-  else {
-    // Exit from the Ready or Suspended Queues (terminated by command)
-    op_terminated(schedule, pid, exit_code);
-    sprintf(g_status_msg, "Terminating PID %d with exit code %d with op_terminated\n", pid, exit_code);
-    print_debug(g_status_msg);
+  for(int i = 0; i < cs_cpus_started && !found; i++) {
+    cs_cpu_s *cpu = &cs_cpus[i];
+    pthread_mutex_lock(&cpu->lock);
+    if(cpu->on_cpu && cpu->on_cpu->pid == pid) {
+      // Exit from the CPU directly (terminated while being run)
+      cs_exiting_process(cpu, exit_code);
+      found = 1;
+    }
+    else if(op_terminated(cpu->schedule, pid, exit_code) == 0) {
+      // Exit from the Ready or Suspended Queues (terminated by command)
+      cs_release_deadline(cpu->schedule->defunct_queue->tail);
+      cs_update_load(cpu);
+      sprintf(msg, "Terminating PID %d on CPU %d with exit code %d with op_terminated\n", pid, cpu->id, exit_code);
+      print_debug(msg);
+      found = 1;
+    }
+    pthread_mutex_unlock(&cpu->lock);
   }
-  if(last_state == 1) {
-    start_cs();
+  if(!found) {
+    // Still in an inbox or between CPUs (being stolen or migrated), the dispatcher that selects it retires it with this code
+    cs_record_lost(pid, exit_code);
+    sprintf(msg, "PID %d exited before it reached a schedule", pid);
+    print_debug(msg);
   }
 } 
 
-// Prints the full Schedule of all processes being tracked.
+// Copies a queue's nodes into copies (the array must have room for the whole queue)
+// Returns the number of nodes copied.
+static int cs_snapshot_queue(Op_queue_s *queue, Op_process_s *copies) {
+  int count = 0;
+  for(Op_process_s *walker = queue->head; walker != NULL; walker = walker->next) {
+    copies[count++] = *walker;
+  }
+  return count;
+}
+
+// Snapshot of the processes a policy is holding (op_walk_ready callback)
+typedef struct cs_snapshot {
+  Op_process_s *copies;
+  int count;
+} cs_snapshot_s;
+
+static void cs_snapshot_visit(void *arg, Op_process_s *process) {
+  cs_snapshot_s *snapshot = (cs_snapshot_s *)arg;
+  snapshot->copies[snapshot->count++] = *process;
+}
+
+// Prints the full Schedule of all processes being tracked, CPU by CPU.
+// Each CPU is copied under its lock and printed after, so the dispatcher only waits on a memcpy, never on the terminal.
 void print_schedule() {
+  char *names[OP_MAX_LEVELS + 4] = {0};
+  int counts[OP_MAX_LEVELS + 4] = {0};
+  char running[MAX_CMD + 32] = {0}; // "Running PID x (cmd)" or "Idle"
+  char policy_queue[MAX_STATUS] = {0};
+  sigset_t old_mask;
+
   print_status("Printing the current Schedule Status...");
-  sprintf(g_status_msg, "...[Ready - High Priority Queue - %d Processes]", op_get_count(schedule->ready_queue_high));
-  print_status(g_status_msg);
-  print_op_queue(schedule->ready_queue_high);
-  sprintf(g_status_msg, "...[Ready - Low Priority Queue - %d Processes]", op_get_count(schedule->ready_queue_low));
-  print_status(g_status_msg);
-  print_op_queue(schedule->ready_queue_low);
-  sprintf(g_status_msg, "...[Defunct Queue - %d Processes]", op_get_count(schedule->defunct_queue));
-  print_status(g_status_msg);
-  print_op_queue(schedule->defunct_queue);
+  for(int i = 0; i < cs_cpus_started; i++) {
+    cs_cpu_s *cpu = &cs_cpus[i];
+    Op_schedule_s *schedule = cpu->schedule;
+    Op_process_s *copies = NULL;
+    int queues = 0, total = 0, ready = 0, copied = 0, levels_at = 0;
+    unsigned long dispatches = 0, steals = 0, idle_waits = 0, parks = 0;
+
+    sprintf(policy_queue, "Ready - %s Policy", schedule->policy->name);
+    cs_shell_lock(cpu, &old_mask);
+    cs_drain(cpu, 0); // Show submissions still in the inbox as Ready
+    ready = op_get_ready_count(schedule);
+    total = ready + op_get_count(schedule->parked_queue) + op_get_count(schedule->defunct_queue);
+    copies = malloc((total > 0 ? total : 1) * sizeof(Op_process_s));
+    if(copies != NULL) {
+      // Deadline jobs run ahead of every policy (heap order, the earliest deadline is first)
+      names[queues] = "Ready - Deadline (EDF) Heap";
+      for(int j = 0; j < schedule->deadline_heap.count; j++) {
+        copies[copied++] = *schedule->deadline_heap.items[j];
+      }
+      counts[queues++] = copied;
+    }
+    if(copies != NULL && schedule->policy != &op_policy_mlfq) {
+      // Other policies don't use the level queues, show their Ready processes as one list
+      cs_snapshot_s snapshot = {copies + copied, 0};
+      schedule->policy->walk(schedule, cs_snapshot_visit, &snapshot);
+      names[queues] = policy_queue;
+      counts[queues++] = snapshot.count;
+      copied += snapshot.count;
+      names[queues] = "Parked Queue";
+      counts[queues] = cs_snapshot_queue(schedule->parked_queue, copies + copied);
+      copied += counts[queues++];
+      names[queues] = "Defunct Queue";
+      counts[queues++] = cs_snapshot_queue(schedule->defunct_queue, copies + copied);
+    }
+    else if(copies != NULL) {
+      // Queue order: Critical, High, middle levels, Low, Parked, Defunct
+      names[queues] = "Ready - Critical Queue";
+      counts[queues] = cs_snapshot_queue(schedule->ready_queue_critical, copies + copied);
+      copied += counts[queues++];
+      levels_at = queues;
+      names[queues] = "Ready - High Priority Queue";
+      counts[queues] = cs_snapshot_queue(schedule->ready_queue_high, copies + copied);
+      copied += counts[queues++];
+      for(int j = 1; j < schedule->mlfq.levels - 1; j++) {
+        names[queues] = NULL; // Numbered level
+        counts[queues] = cs_snapshot_queue(schedule->ready_queues[j], copies + copied);
+        copied += counts[queues++];
+      }
+      names[queues] = "Ready - Low Priority Queue";
+      counts[queues] = cs_snapshot_queue(schedule->ready_queue_low, copies + copied);
+      copied += counts[queues++];
+      names[queues] = "Parked Queue";
+      counts[queues] = cs_snapshot_queue(schedule->parked_queue, copies + copied);
+      copied += counts[queues++];
+      names[queues] = "Defunct Queue";
+      counts[queues] = cs_snapshot_queue(schedule->defunct_queue, copies + copied);
+      copied += counts[queues++];
+    }
+    if(cpu->on_cpu) {
+      sprintf(running, "Running PID %d (%s)", cpu->on_cpu->pid, cpu->on_cpu->cmd);
+    }
+    else {
+      sprintf(running, "Idle");
+    }
+    dispatches = cpu->dispatches;
+    steals = cpu->steals;
+    idle_waits = cpu->idle_waits;
+    parks = cpu->parks;
+    cs_shell_unlock(cpu, &old_mask);
+
+    if(cs_affinity) {
+      sprintf(g_status_msg, "[CPU %d%s] Pinned to host core %d (LLC group %d)", cpu->id, (i < cs_cpu_count)?"":" Offline", cpu->core, cpu->llc);
+      print_status(g_status_msg);
+    }
+    sprintf(g_status_msg, "[CPU %d%s] %s | %d Ready | %lu Dispatches | %lu Parked | %lu Stolen | %lu Idle Waits", cpu->id, (i < cs_cpu_count)?"":" Offline", running, ready, dispatches, parks, steals, idle_waits);
+    print_status(g_status_msg);
+    if(copies == NULL) {
+      print_warning("Could not allocate a copy of this CPU's queues to print.");
+      continue;
+    }
+    copied = 0;
+    for(int q = 0; q < queues; q++) {
+      if(names[q] != NULL) {
+        sprintf(g_status_msg, "...[%s - %d Processes]", names[q], counts[q]);
+      }
+      else {
+        sprintf(g_status_msg, "...[Ready - Level %d Queue - %d Processes]", q - levels_at, counts[q]);
+      }
+      print_status(g_status_msg);
+      for(int j = 0; j < counts[q]; j++) {
+        print_process_node(&copies[copied + j]);
+      }
+      copied += counts[q];
+    }
+    free(copies);
+  }
 }
 
 // Prints a single Scheduler Queue
@@ -237,12 +1142,40 @@ void print_op_queue(Op_queue_s *queue) {
 }
 
 // Prints a schedule tracked process
+// Deadline jobs are tagged [D], Defunct ones show whether they finished by their deadline.
 void print_process_node(Op_process_s *node) {
+  char priority[64] = {0};
+  char deadline[64] = {0};
+  char bound[64] = {0};
+  if(node->priority != DEFAULT_PRIORITY) {
+    sprintf(priority, " (Priority: %d)", node->priority);
+  }
+  if(node->tickets != DEFAULT_TICKETS) {
+    sprintf(priority + strlen(priority), " (Tickets: %d)", node->tickets);
+  }
+  if(node->deadline_ns != 0) {
+    unsigned long long now = ((node->state >> 28)&1) ? node->exit_ns : op_now_ns();
+    if(now > node->deadline_ns) {
+      sprintf(deadline, " (Deadline MISSED by %.1f ms)", (now - node->deadline_ns) / 1e6);
+    }
+    else if((node->state >> 28)&1) {
+      sprintf(deadline, " (Deadline met, %.1f ms to spare)", (node->deadline_ns - now) / 1e6);
+    }
+    else {
+      sprintf(deadline, " (Deadline in %.1f ms)", (node->deadline_ns - now) / 1e6);
+    }
+  }
+  if(node->bound != OP_BOUND_UNKNOWN) {
+    sprintf(bound, " (%s, %u.%u%% busy)", (node->bound == OP_BOUND_IO)?"I/O-bound":(node->bound == OP_BOUND_CPU)?"CPU-bound":"Mixed", node->busy_permille / 10, node->busy_permille % 10);
+  }
+  if(node->parks > 0) {
+    sprintf(bound + strlen(bound), " (Parked: %u)", node->parks);
+  }
   if((node->state >> 28)&1) {
-    sprintf(g_status_msg, "     [PID :%d] %s%s %s (Exit Code: %d)", node->pid, ((node->state>>31)&1)?"[C]":"", ((node->state>>30)&1)?"[L]":"", node->cmd, ((node->state)&0x0FFFFFFF));
+    sprintf(g_status_msg, "     [PID :%d] %s%s%s %s (Exit Code: %d) (Migrations: %d)%s%s%s", node->pid, node->deadline_ns?"[D]":"", ((node->state>>31)&1)?"[C]":"", ((node->state>>30)&1)?"[L]":"", node->cmd, ((node->state)&0x0FFFFFFF), node->migrations, bound, priority, deadline);
   }
   else {
-    sprintf(g_status_msg, "     [PID :%d] %s%s %s", node->pid, ((node->state>>31)&1)?"[C]":"", ((node->state>>30)&1)?"[L]":"", node->cmd);
+    sprintf(g_status_msg, "     [PID :%d] %s%s%s %s (Migrations: %d)%s%s%s", node->pid, node->deadline_ns?"[D]":"", ((node->state>>31)&1)?"[C]":"", ((node->state>>30)&1)?"[L]":"", node->cmd, node->migrations, bound, priority, deadline);
   }
   print_status(g_status_msg);
 }
@@ -251,8 +1184,8 @@ void print_process_node(Op_process_s *node) {
 void start_cs() {
   pthread_mutex_lock(&cs_run_m);
   if(cs_run == 0) {
-    cs_run = 1;
-    pthread_mutex_unlock(&cs_cv_m);
+    __atomic_store_n(&cs_run, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&cs_run_cv);
   }
   pthread_mutex_unlock(&cs_run_m);
 }
@@ -261,10 +1194,30 @@ void start_cs() {
 void stop_cs() {
   pthread_mutex_lock(&cs_run_m);
   if(cs_run == 1) {
-    cs_run = 0;
-    pthread_mutex_lock(&cs_cv_m);
+    __atomic_store_n(&cs_run, 0, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&cs_run_m);
+  cs_kick_idle();
+}
+
+// Sets how many virtual CPUs take work (1 to MAX_CPUS).
+// New CPUs get a dispatcher thread, removed CPUs hand their processes back and park.
+void set_cpus(int count) {
+  if(count < 1 || count > MAX_CPUS) {
+    sprintf(g_status_msg, "You need between 1 and %d CPUs.", MAX_CPUS);
+    print_warning(g_status_msg);
+    return;
+  }
+  pthread_mutex_lock(&cs_run_m);
+  while(cs_cpus_started < count) {
+    cs_start_cpu();
   }
+  __atomic_store_n(&cs_cpu_count, count, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&cs_run_cv);
   pthread_mutex_unlock(&cs_run_m);
+  cs_kick_idle();
+  sprintf(g_status_msg, "CS System: %d CPU%s online", count, (count == 1)?"":"s");
+  print_status(g_status_msg);
 }
 
 // Toggles the CS Processing
@@ -277,7 +1230,7 @@ void toggle_cs() {
     stop_cs();
   }
   else {
-    sprintf(g_status_msg, "Starting CS System: %d usec Run, %d usec Between", sleep_usec_time, between_usec_time);
+    sprintf(g_status_msg, "Starting CS System: %ld usec Run, %ld usec Between", sleep_usec_time, between_usec_time);
     print_status(g_status_msg);
     start_cs();
   }
@@ -289,27 +1242,426 @@ void print_cs_status() {
   int state = cs_run;
   pthread_mutex_unlock(&cs_run_m);
   if(state == 1) {
-    sprintf(g_status_msg, "CS System Running: runtime %d usec, delaytime %d usec", sleep_usec_time, between_usec_time);
+    sprintf(g_status_msg, "CS System Running: %d CPUs, runtime %ld usec, delaytime %ld usec", cs_cpu_count, sleep_usec_time, between_usec_time);
     print_status(g_status_msg);
   }
   else {
-    sprintf(g_status_msg, "CS System Stopped: runtime %d usec, delaytime %d usec", sleep_usec_time, between_usec_time);
+    sprintf(g_status_msg, "CS System Stopped: %d CPUs, runtime %ld usec, delaytime %ld usec", cs_cpu_count, sleep_usec_time, between_usec_time);
     print_status(g_status_msg);
   }
+  print_policy_status();
+  print_deadline_status();
+  if(cs_policy == &op_policy_mlfq) {
+    print_mlfq_status();
+  }
+  print_affinity_status();
+  print_adapt_status();
+  print_probe_status();
+  print_pool_status();
   return;
 }
 
+// Switches the Scheduler between the classic High/Low queues and an MLFQ
+void set_mlfq(Op_mlfq_s *config) {
+  int last_state = -1;
+  int ret = 0;
+  sigset_t old_mask;
+
+  pthread_mutex_lock(&cs_run_m);
+  last_state = cs_run;
+  pthread_mutex_unlock(&cs_run_m);
+  stop_cs(); // Queues are re-leveled, so hold the CS off while it happens.
+  pthread_mutex_lock(&cs_run_m);
+  cs_shell_lock(&cs_cpus[0], &old_mask);
+  ret = op_set_mlfq(cs_cpus[0].schedule, config);
+  cs_shell_unlock(&cs_cpus[0], &old_mask);
+  if(ret == 0) {
+    cs_mlfq = *config;
+    for(int i = 1; i < cs_cpus_started; i++) {
+      cs_shell_lock(&cs_cpus[i], &old_mask);
+      op_set_mlfq(cs_cpus[i].schedule, config);
+      cs_shell_unlock(&cs_cpus[i], &old_mask);
+    }
+  }
+  pthread_mutex_unlock(&cs_run_m);
+  if(last_state == 1) {
+    start_cs();
+  }
+
+  if(ret != 0) {
+    print_warning("Invalid MLFQ settings, the schedule was not changed.");
+    return;
+  }
+  print_mlfq_status();
+}
+
+// Prints the Scheduler level settings
+void print_mlfq_status() {
+  int len = 0;
+  if(cs_mlfq.demote == 0 && cs_mlfq.levels == 2) {
+    print_status("Scheduler: Classic High/Low Queues (Low runs 2x, aging promotes)");
+    return;
+  }
+  len = sprintf(g_status_msg, "Scheduler: MLFQ %d Levels, boost every %d ticks, quanta", cs_mlfq.levels, cs_mlfq.boost_ticks);
+  for(int i = 0; i < cs_mlfq.levels; i++) {
+    len += sprintf(g_status_msg + len, " %dx", cs_mlfq.quantum[i]);
+  }
+  print_status(g_status_msg);
+}
+
+// Switches every CPU's schedule to the named policy, moving the queued processes across
+void set_policy(char *name) {
+  Op_policy_s *policy = op_find_policy(name);
+  int last_state = -1;
+  int ret = 0;
+  int moved = 0;
+  sigset_t old_mask;
+
+  if(policy == NULL) {
+    sprintf(g_status_msg, "There is no Scheduling Policy called %s.", name);
+    print_warning(g_status_msg);
+    print_policy_status();
+    return;
+  }
+
+  pthread_mutex_lock(&cs_run_m);
+  last_state = cs_run;
+  pthread_mutex_unlock(&cs_run_m);
+  stop_cs(); // Hold the CS off while the queues change hands.
+  pthread_mutex_lock(&cs_run_m);
+  for(int i = 0; i < cs_cpus_started && ret == 0; i++) {
+    cs_shell_lock(&cs_cpus[i], &old_mask);
+    cs_drain(&cs_cpus[i], 0);
+    moved += op_get_ready_count(cs_cpus[i].schedule);
+    ret = op_set_policy(cs_cpus[i].schedule, policy);
+    cs_shell_unlock(&cs_cpus[i], &old_mask);
+  }
+  if(ret == 0) {
+    cs_policy = policy;
+  }
+  else { // Put every CPU back on the one they all share
+    for(int i = 0; i < cs_cpus_started; i++) {
+      cs_shell_lock(&cs_cpus[i], &old_mask);
+      op_set_policy(cs_cpus[i].schedule, cs_policy);
+      cs_shell_unlock(&cs_cpus[i], &old_mask);
+    }
+  }
+  pthread_mutex_unlock(&cs_run_m);
+  if(last_state == 1) {
+    start_cs();
+  }
+
+  if(ret != 0) {
+    print_warning("Could not set up the new Scheduling Policy, the schedule was not changed.");
+    return;
+  }
+  sprintf(g_status_msg, "Switched to the %s policy, moved %d Ready process%s.", policy->name, moved, (moved == 1)?"":"es");
+  print_status(g_status_msg);
+}
+
+// Prints the Scheduling Policy in use and the ones available
+void print_policy_status() {
+  int len = 0;
+  sprintf(g_status_msg, "Scheduling Policy: %s (%s)", cs_policy->name, cs_policy->about);
+  print_status(g_status_msg);
+  len = sprintf(g_status_msg, "...Available:");
+  for(int i = 0; op_policies[i] != NULL; i++) {
+    len += sprintf(g_status_msg + len, " %s", op_policies[i]->name);
+  }
+  print_status(g_status_msg);
+}
+
+// Admission control for a deadline job (EDF): reserves runtime/deadline of a CPU for it if the
+//  admitted total stays within the bound on every online CPU, otherwise leaves it unadmitted.
+// Returns 0 if admitted or -1 if it must be rejected.
+int cs_admit_deadline(long runtime_usec, long deadline_usec) {
+  unsigned long want = cs_deadline_util(runtime_usec, deadline_usec);
+  unsigned long limit = (unsigned long)__atomic_load_n(&cs_deadline_bound, __ATOMIC_RELAXED) * 10000UL * __atomic_load_n(&cs_cpu_count, __ATOMIC_ACQUIRE);
+  unsigned long admitted = __atomic_load_n(&cs_deadline_ppm, __ATOMIC_RELAXED);
+
+  do {
+    if(admitted + want > limit) {
+      return -1;
+    }
+  } while(!__atomic_compare_exchange_n(&cs_deadline_ppm, &admitted, admitted + want, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return 0;
+}
+
+// Sets the percent of each CPU deadline jobs may be admitted up to (already admitted jobs keep running)
+void set_deadline_bound(long percent) {
+  __atomic_store_n(&cs_deadline_bound, percent, __ATOMIC_RELAXED);
+  print_deadline_status();
+}
+
+// Prints the admitted deadline utilization against its bound
+void print_deadline_status() {
+  sprintf(g_status_msg, "Deadline (EDF) Utilization: %.1f%% admitted of %ld%% x %d CPUs", __atomic_load_n(&cs_deadline_ppm, __ATOMIC_RELAXED) / 1e4, cs_deadline_bound, cs_cpu_count);
+  print_status(g_status_msg);
+}
+
+// Toggles pinning resumed children (and their dispatcher) to each CPU's host core
+void toggle_affinity() {
+  __atomic_store_n(&cs_affinity, !cs_affinity, __ATOMIC_RELAXED);
+  print_affinity_status();
+}
+
+// Prints the affinity mode and host cache topology
+void print_affinity_status() {
+  sprintf(g_status_msg, "CPU Affinity: %s (%d host cores in %d LLC groups)", cs_affinity?"On":"Off", cs_host_count, cs_llc_groups);
+  print_status(g_status_msg);
+}
+
+// Toggles scaling each quantum by whether the job is CPU-bound or I/O-bound
+void toggle_adapt() {
+  __atomic_store_n(&cs_adapt, !cs_adapt, __ATOMIC_RELAXED);
+  print_adapt_status();
+}
+
+// Prints the adaptive quantum mode and what each class gets
+void print_adapt_status() {
+  sprintf(g_status_msg, "Adaptive Quantum: %s (I/O-bound %d%%, CPU-bound %d%% of the runtime)", cs_adapt?"On":"Off", ADAPT_IO_PERCENT, ADAPT_CPU_PERCENT);
+  print_status(g_status_msg);
+}
+
+// Toggles probing each quantum and parking jobs found asleep
+void toggle_probe() {
+  __atomic_store_n(&cs_probe, !cs_probe, __ATOMIC_RELAXED);
+  print_probe_status();
+}
+
+// Prints the runnability probe mode and its timings
+void print_probe_status() {
+  sprintf(g_status_msg, "Runnability Probe: %s (asleep %d usec into a quantum parks the job for %d usec)", cs_probe?"On":"Off", PARK_PROBE_USEC, PARK_RECHECK_USEC);
+  print_status(g_status_msg);
+}
+
+// Prints the Scheduler node pool counters
+void print_pool_status() {
+  Op_pool_stats_s stats;
+  op_pool_stats(&stats);
+  sprintf(g_status_msg, "Node %s: %d live, %d free, %d peak, %d slabs", USE_NODE_POOL?"Pool":"Malloc", stats.live, stats.free, stats.peak, stats.slabs);
+  print_status(g_status_msg);
+}
+
 // Set the time for each process to run for (Quantum)
-void set_run_usec(useconds_t time) {
+void set_run_usec(long time) {
   sleep_usec_time = time;
-  sprintf(g_status_msg, "Setting CS System: runtime %d usec, delaytime %d usec", sleep_usec_time, between_usec_time);
+  sprintf(g_status_msg, "Setting CS System: runtime %ld usec, delaytime %ld usec", sleep_usec_time, between_usec_time);
   print_status(g_status_msg);
 }
 
 // Set the time between processes running
-void set_between_usec(useconds_t time) {
+void set_between_usec(long time) {
   between_usec_time = time;
-  sprintf(g_status_msg, "Setting CS System: runtime %d usec, delaytime %d usec", sleep_usec_time, between_usec_time);
+  sprintf(g_status_msg, "Setting CS System: runtime %ld usec, delaytime %ld usec", sleep_usec_time, between_usec_time);
+  print_status(g_status_msg);
+}
+
+
+// Prints measured vs configured quantum statistics for every CPU
+void print_cs_timing() {
+  print_status("Quantum Timing (measured SIGCONT to SIGTSTP vs configured runtime)...");
+  for(int i = 0; i < cs_cpus_started; i++) {
+    cs_cpu_s *cpu = &cs_cpus[i];
+    sigset_t old_mask;
+    cs_shell_lock(cpu, &old_mask);
+    cs_timing_s t = cpu->timing;
+    cs_shell_unlock(cpu, &old_mask);
+    if(t.slices == 0) {
+      sprintf(g_status_msg, "[CPU %d] No full quanta measured yet", cpu->id);
+    }
+    else {
+      double mean = t.sum_error / t.slices;
+      double jitter = sqrt(fabs(t.sum_sq_error / t.slices - mean * mean));
+      sprintf(g_status_msg, "[CPU %d] %lu quanta | mean error %+.1f usec | jitter %.1f usec | range %+ld..%+ld usec | %lu overruns > %d usec",
+          cpu->id, t.slices, mean, jitter, t.min_error, t.max_overrun, t.overruns, TIMING_SLACK_USEC);
+    }
+    print_status(g_status_msg);
+    if(t.dispatched > 0) {
+      sprintf(g_status_msg, "[CPU %d] Dispatch latency mean %.1f usec | max %ld usec over %lu dispatches", cpu->id, t.sum_late / t.dispatched, t.max_late, t.dispatched);
+      print_status(g_status_msg);
+    }
+    if(t.cutoffs > 0) {
+      sprintf(g_status_msg, "[CPU %d] %lu quanta cut short by exits | %.3f sec of idle CPU time reclaimed", cpu->id, t.cutoffs, t.reclaimed / 1e6);
+      print_status(g_status_msg);
+    }
+  }
+}
+
+// Clears the quantum statistics on every CPU
+void reset_cs_timing() {
+  sigset_t old_mask;
+  for(int i = 0; i < cs_cpus_started; i++) {
+    cs_shell_lock(&cs_cpus[i], &old_mask);
+    memset(&cs_cpus[i].timing, 0, sizeof(cs_timing_s));
+    cs_shell_unlock(&cs_cpus[i], &old_mask);
+  }
+  print_status("Quantum Timing statistics reset.");
+}
+
+// Sorts values and prints their mean and p99 (values in nanoseconds, printed in msec)
+static void cs_print_dist(char *name, double *values, int count) {
+  double sum = 0;
+  int p99 = 0;
+
+  if(count == 0) {
+    sprintf(g_status_msg, "%-11s no samples", name);
+    print_status(g_status_msg);
+    return;
+  }
+  for(int i = 1; i < count; i++) { // Insertion sort, the Defunct Queues are small
+    double value = values[i];
+    int j = i - 1;
+    for(; j >= 0 && values[j] > value; j--) {
+      values[j + 1] = values[j];
+    }
+    values[j + 1] = value;
+  }
+  for(int i = 0; i < count; i++) {
+    sum += values[i];
+  }
+  p99 = (count * 99 + 99) / 100 - 1; // ceil(0.99 * count) - 1
+  sprintf(g_status_msg, "%-11s mean %10.3f msec | p99 %10.3f msec | max %10.3f msec", name, sum / count / 1e6, values[p99] / 1e6, values[count - 1] / 1e6);
+  print_status(g_status_msg);
+}
+
+// Prints CPU accounting for every finished (Defunct) job, then wait/response/turnaround figures
+//  and Jain's fairness index over each job's CPU share (cpu time / turnaround).
+void print_cs_stats() {
+  Op_process_s *jobs = NULL;
+  double *wait = NULL, *response = NULL, *turnaround = NULL;
+  double share_sum = 0, share_sq_sum = 0;
+  int total = 0, count = 0, responded = 0;
+  sigset_t old_mask;
+
+  // Copy every CPU's Defunct Queue under its lock, then work on the copies
+  for(int i = 0; i < cs_cpus_started; i++) {
+    cs_shell_lock(&cs_cpus[i], &old_mask);
+    total += op_get_count(cs_cpus[i].schedule->defunct_queue);
+    cs_shell_unlock(&cs_cpus[i], &old_mask);
+  }
+  total += 2 * cs_cpus_started; // Room for exits that land while copying
+  jobs = malloc(total * sizeof(Op_process_s));
+  wait = malloc(total * sizeof(double));
+  response = malloc(total * sizeof(double));
+  turnaround = malloc(total * sizeof(double));
+  if(jobs == NULL || wait == NULL || response == NULL || turnaround == NULL) {
+    print_warning("Could not allocate room for the job statistics.");
+    free(jobs); free(wait); free(response); free(turnaround);
+    return;
+  }
+  for(int i = 0; i < cs_cpus_started; i++) {
+    cs_shell_lock(&cs_cpus[i], &old_mask);
+    for(Op_process_s *walker = cs_cpus[i].schedule->defunct_queue->head; walker != NULL && count < total; walker = walker->next) {
+      jobs[count++] = *walker;
+    }
+    cs_shell_unlock(&cs_cpus[i], &old_mask);
+  }
+
+  print_status("Job Statistics (finished jobs, times in msec)...");
+  for(int i = 0; i < count; i++) {
+    Op_process_s *job = &jobs[i];
+    double job_turnaround = (double)(job->exit_ns - job->submit_ns);
+    wait[i] = (double)job->wait_ns;
+    turnaround[i] = job_turnaround;
+    if(job->first_run_ns != 0) {
+      response[responded++] = (double)(job->first_run_ns - job->submit_ns);
+    }
+    if(job_turnaround > 0) {
+      double share = (double)job->cpu_ns / job_turnaround;
+      share_sum += share;
+      share_sq_sum += share * share;
+    }
+    sprintf(g_status_msg, "     [PID :%d] %s | cpu %.3f | quanta %u | wait %.3f (low %.3f) | response %s%.3f | turnaround %.3f",
+        job->pid, job->cmd, job->cpu_ns / 1e6, job->quanta, job->wait_ns / 1e6, job->low_wait_ns / 1e6,
+        (job->first_run_ns != 0)?"":"never ran ", (job->first_run_ns != 0)?(job->first_run_ns - job->submit_ns) / 1e6:0.0, job_turnaround / 1e6);
+    print_status(g_status_msg);
+  }
+
+  sprintf(g_status_msg, "%d finished jobs", count);
   print_status(g_status_msg);
+  cs_print_dist("Wait", wait, count);
+  cs_print_dist("Response", response, responded);
+  cs_print_dist("Turnaround", turnaround, count);
+  if(share_sq_sum > 0) {
+    sprintf(g_status_msg, "Jain's fairness index (CPU share): %.3f (1.0 is perfectly fair)", (share_sum * share_sum) / (count * share_sq_sum));
+    print_status(g_status_msg);
+  }
+
+  free(jobs);
+  free(wait);
+  free(response);
+  free(turnaround);
 }
 
+// Prints the percentiles of one histogram (values in usec)
+static void cs_print_hist(char *name, char *class_name, cs_hist_s *hist) {
+  static const double percentiles[] = {50, 90, 99, 99.9};
+  unsigned long long values[4] = {0};
+  unsigned long count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+  unsigned long seen = 0;
+  int p = 0;
+
+  if(count == 0) {
+    sprintf(g_status_msg, "%-10s %-8s no samples", name, class_name);
+    print_status(g_status_msg);
+    return;
+  }
+  for(int i = 0; i < HIST_BUCKETS && p < 4; i++) {
+    seen += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    while(p < 4 && seen >= (unsigned long)(count * percentiles[p] / 100.0 + 0.5) && seen > 0) {
+      values[p++] = cs_hist_bucket_top(i);
+    }
+  }
+  unsigned long long max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+  for(p = 0; p < 4; p++) { // A bucket's top can pass the largest value actually seen
+    values[p] = (values[p] > max) ? max : values[p];
+  }
+  sprintf(g_status_msg, "%-10s %-8s %8lu samples | p50 %9.1f | p90 %9.1f | p99 %9.1f | p99.9 %9.1f | max %9.1f usec",
+      name, class_name, count, values[0] / 1e3, values[1] / 1e3, values[2] / 1e3, values[3] / 1e3, max / 1e3);
+  print_status(g_status_msg);
+}
+
+// Prints scheduling latency (Ready -> SIGCONT) and quantum gap (SIGTSTP -> SIGCONT) percentiles per priority class
+void print_cs_latency() {
+  print_status("Latency Percentiles (bucket upper bounds, within 6.25%)...");
+  for(int i = 0; i < CS_CLASSES; i++) {
+    cs_print_hist("Scheduling", cs_class_names[i], &cs_sched_hist[i]);
+  }
+  for(int i = 0; i < CS_CLASSES; i++) {
+    cs_print_hist("Gap", cs_class_names[i], &cs_gap_hist[i]);
+  }
+}
+
+// Clears every latency histogram
+void reset_cs_latency() {
+  for(int i = 0; i < CS_CLASSES; i++) {
+    for(int j = 0; j < HIST_BUCKETS; j++) {
+      __atomic_store_n(&cs_sched_hist[i].buckets[j], 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&cs_gap_hist[i].buckets[j], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&cs_sched_hist[i].count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cs_sched_hist[i].max_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cs_gap_hist[i].count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cs_gap_hist[i].max_ns, 0, __ATOMIC_RELAXED);
+  }
+  print_status("Latency histograms reset.");
+}
+
+// Dumps the scheduler trace ring to path as Chrome trace-event JSON (opens in Perfetto / chrome://tracing)
+void dump_cs_trace(char *path) {
+  int count = trace_dump_chrome(path);
+  if(count < 0) {
+    sprintf(g_status_msg, "Could not write the trace to %.400s", path);
+    print_warning(g_status_msg);
+    return;
+  }
+  sprintf(g_status_msg, "Wrote %d scheduler events to %.400s", count, path);
+  print_status(g_status_msg);
+}
+
+// Prints how much of the trace ring is in use
+void print_trace_status() {
+  sprintf(g_status_msg, "Trace: %lu of %d events buffered (trace FILE to dump, trace clear to empty)", trace_count(), TRACE_EVENTS);
+  print_status(g_status_msg);
+}
@@ -9,15 +9,17 @@
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <limits.h>
 // Local Includes
 #include "vm.h"
 #include "vm_support.h"
 #include "vm_process.h"
 #include "vm_printing.h"
 #include "vm_cs.h"
+#include "vm_trace.h"
 
 /* Local Definitions */
-static char *builtin_cmds[] = {"quit", "exit", "help", "terminate", "start", "stop", "debug", "schedule", "delaytime", "runtime", "status"};
+static char *builtin_cmds[] = {"quit", "exit", "help", "terminate", "start", "stop", "debug", "schedule", "delaytime", "runtime", "status", "mlfq", "cpus", "affinity", "adapt", "probe", "timing", "stats", "latency", "trace", "policy", "deadline"};
 
 /* Local Prototypes */
 static int get_user_input(char *line);
@@ -26,6 +28,8 @@ static void execute_command(process_data_t *data);
 static int is_builtin(process_data_t *data);
 static void print_process_data(process_data_t *data);
 static int is_whitespace(char *str);
+static int parse_long(char *str, long *value);
+static int parse_usec(char *str, long *usec);
 
 static void print_help();
 static process_data_t *initialize_data(const char *str);
@@ -152,8 +156,8 @@ static void execute_builtin(process_data_t *data) {
     }
     errno = 0;
     char *p_time = data->argv[1];
-    useconds_t time = (useconds_t)strtol(data->argv[1], &p_time, 10);
-    if(*p_time == '\0') {
+    long time = strtol(data->argv[1], &p_time, 10);
+    if(*p_time == '\0' && errno == 0 && time >= 0) {
       set_run_usec(time);
     }
     else {
@@ -161,6 +165,125 @@ static void execute_builtin(process_data_t *data) {
       return;
     }
   }
+  // mlfq - Switch to an N level Multi-Level Feedback Queue (or back to High/Low with off)
+  else if(strncmp(data->cmd, "mlfq", 4) == 0) {
+    Op_mlfq_s config;
+    long value = 0;
+    int i = 0;
+    if(data->argv[1] == NULL || is_whitespace(data->argv[1])) {
+      print_warning("You need to enter a level count (and optional boost ticks and quanta) or off.\n\teg. mlfq 4 50 1 2 4 8");
+      return;
+    }
+    op_mlfq_classic(&config);
+    if(strncmp(data->argv[1], "off", 3) == 0) {
+      set_mlfq(&config);
+      return;
+    }
+    if(parse_long(data->argv[1], &value) != 0 || value < 2 || value > OP_MAX_LEVELS) {
+      sprintf(g_status_msg, "You need a level count from 2 to %d.\n\teg. mlfq 4", OP_MAX_LEVELS);
+      print_warning(g_status_msg);
+      return;
+    }
+    config.levels = value;
+    config.demote = 1;
+    config.boost_ticks = MLFQ_BOOST_TICKS;
+    for(i = 0; i < config.levels; i++) {
+      config.quantum[i] = 1 << i; // Each level down doubles the quantum by default
+    }
+    if(data->argv[2] != NULL) {
+      if(parse_long(data->argv[2], &value) != 0 || value < 0) {
+        print_warning("You need a valid boost interval in ticks.\n\teg. mlfq 4 50");
+        return;
+      }
+      config.boost_ticks = value;
+    }
+    for(i = 0; i < config.levels && i + 3 < MAX_ARGS && data->argv[i + 3] != NULL; i++) {
+      if(parse_long(data->argv[i + 3], &value) != 0 || value < 1) {
+        print_warning("You need a valid quantum multiplier for each level.\n\teg. mlfq 3 50 1 2 4");
+        return;
+      }
+      config.quantum[i] = value;
+    }
+    set_mlfq(&config);
+  }
+  // deadline - Shows or sets the EDF admission bound (percent of each CPU)
+  else if(strncmp(data->cmd, "deadline", 8) == 0) {
+    long value = 0;
+    if(data->argv[1] == NULL) {
+      print_deadline_status();
+      return;
+    }
+    if(parse_long(data->argv[1], &value) != 0 || value < 1 || value > 100) {
+      print_warning("deadline takes a utilization bound from 1 to 100 (percent of each CPU).");
+      return;
+    }
+    set_deadline_bound(value);
+  }
+  // policy - Switches the Scheduling Policy at runtime (or lists them)
+  else if(strncmp(data->cmd, "policy", 6) == 0) {
+    if(data->argv[1] == NULL || is_whitespace(data->argv[1])) {
+      print_policy_status();
+    }
+    else {
+      set_policy(data->argv[1]);
+    }
+  }
+  // trace - Dumps the scheduler event ring as Chrome trace JSON (or clears it)
+  else if(strncmp(data->cmd, "trace", 5) == 0) {
+    if(data->argv[1] == NULL || is_whitespace(data->argv[1])) {
+      print_trace_status();
+    }
+    else if(strcmp(data->argv[1], "clear") == 0) {
+      trace_clear();
+      print_status("Trace cleared.");
+    }
+    else {
+      dump_cs_trace(data->argv[1]);
+    }
+  }
+  // latency - Prints (or resets) the scheduling latency and quantum gap percentiles
+  else if(strncmp(data->cmd, "latency", 7) == 0) {
+    if(data->argv[1] != NULL && strncmp(data->argv[1], "reset", 5) == 0) {
+      reset_cs_latency();
+    }
+    else {
+      print_cs_latency();
+    }
+  }
+  // stats - Prints CPU accounting for finished jobs
+  else if(strncmp(data->cmd, "stats", 5) == 0) {
+    print_cs_stats();
+  }
+  // timing - Prints (or resets) measured vs configured quantum statistics
+  else if(strncmp(data->cmd, "timing", 6) == 0) {
+    if(data->argv[1] != NULL && strncmp(data->argv[1], "reset", 5) == 0) {
+      reset_cs_timing();
+    }
+    else {
+      print_cs_timing();
+    }
+  }
+  // adapt - Toggles scaling each quantum by the job's CPU-bound/I/O-bound class
+  else if(strncmp(data->cmd, "adapt", 5) == 0) {
+    toggle_adapt();
+  }
+  // probe - Toggles parking jobs found asleep early in their quantum
+  else if(strncmp(data->cmd, "probe", 5) == 0) {
+    toggle_probe();
+  }
+  // affinity - Toggles pinning processes to their virtual CPU's host core
+  else if(strncmp(data->cmd, "affinity", 8) == 0) {
+    toggle_affinity();
+  }
+  // cpus - Change how many virtual CPUs run processes at once
+  else if(strncmp(data->cmd, "cpus", 4) == 0) {
+    long count = 0;
+    if(data->argv[1] == NULL || is_whitespace(data->argv[1]) || parse_long(data->argv[1], &count) != 0) {
+      print_warning("You need to enter a number of CPUs.\n\teg. cpus 4");
+      return;
+    }
+    set_cpus(count);
+  }
   // Change the Delay (how long to sleep between each process running)
   else if(strncmp(data->cmd, "delaytime", 9) == 0) {
     if(data->argv[1] == NULL || is_whitespace(data->argv[1])) {
@@ -169,8 +292,8 @@ static void execute_builtin(process_data_t *data) {
     }
     errno = 0;
     char *p_time = data->argv[1];
-    useconds_t time = (useconds_t)strtol(data->argv[1], &p_time, 10);
-    if(*p_time == '\0') {
+    long time = strtol(data->argv[1], &p_time, 10);
+    if(*p_time == '\0' && errno == 0 && time >= 0) {
       set_between_usec(time);
     }
     else {
@@ -182,6 +305,13 @@ static void execute_builtin(process_data_t *data) {
 
 /* Executes a local (or /usr/bin) command */
 static void execute_command(process_data_t *data) {
+  // Deadline jobs only start if the CPUs can still meet every admitted deadline
+  if(data->deadline_usec > 0 && cs_admit_deadline(data->runtime_usec, data->deadline_usec) != 0) {
+    sprintf(g_status_msg, "Rejected: %s needs %.1f%% of a CPU, more than the deadline bound has left (see status).", data->cmd, 100.0 * data->runtime_usec / data->deadline_usec);
+    print_warning(g_status_msg);
+    free_process(data);
+    return;
+  }
   // Creates the process and loads it into the Ready Queue
   create_process(data);
 }
@@ -241,6 +371,12 @@ static void print_process_data(process_data_t *data) {
   print_debug(g_status_msg);
   sprintf(g_status_msg, "| - [Is Critical: %s]", data->is_critical?"Yes":"No");
   print_debug(g_status_msg);
+  sprintf(g_status_msg, "| - [Priority: %d]", data->priority);
+  print_debug(g_status_msg);
+  sprintf(g_status_msg, "| - [Tickets: %d]", data->tickets);
+  print_debug(g_status_msg);
+  sprintf(g_status_msg, "| - [Deadline: %ld usec, Runtime: %ld usec]", data->deadline_usec, data->runtime_usec);
+  print_debug(g_status_msg);
   for(int i = 0; i < MAX_ARGS && data->argv[i] != NULL; i++) {
     sprintf(g_status_msg, "| - [Arg %2d: %s]", i, data->argv[i]);
     print_debug(g_status_msg);
@@ -267,6 +403,10 @@ static process_data_t *parse_input(char *str) {
   data->cmd = p_tok;  // Guaranteed in-scope as it's pointing to data->input_toks
   data->is_critical = 0; // Initialize to Non-Priority
   data->is_low = 0; // Default Priority (high-priority)
+  data->priority = DEFAULT_PRIORITY;
+  data->tickets = DEFAULT_TICKETS;
+  data->deadline_usec = 0;
+  data->runtime_usec = 0;
   data->argv[0] = data->cmd;
   
   // Optionally restrict commands to local directory binaries only (set in inc/vm_settings.h)
@@ -284,11 +424,16 @@ static process_data_t *parse_input(char *str) {
 #endif
 
   // Step 3: Populate Arguments
+  // Scheduler options (-p, -t, -d, -r) only count after a -- separator, so CMD keeps flags like ls -t
   int arg = 1;
+  int sched_opts = 0;
   do {
     p_tok = strtok(NULL, " ");
     if(p_tok != NULL) {
-      if(strncmp(p_tok, "-c", 2) == 0) {
+      if(!sched_opts && strcmp(p_tok, "--") == 0) {
+        sched_opts = 1;
+      }
+      else if(strncmp(p_tok, "-c", 2) == 0) {
         data->is_critical = 1;
       }
       else if(strncmp(p_tok, "-l", 2) == 0) {
@@ -296,12 +441,58 @@ static process_data_t *parse_input(char *str) {
           data->is_low = 1;
         } 
       }
+      else if(sched_opts && strcmp(p_tok, "-p") == 0) {
+        long value = 0;
+        p_tok = strtok(NULL, " ");
+        if(p_tok == NULL || parse_long(p_tok, &value) != 0 || value < MIN_PRIORITY || value > MAX_PRIORITY) {
+          sprintf(g_status_msg, "-p needs a priority from %d to %d.", MIN_PRIORITY, MAX_PRIORITY);
+          print_warning(g_status_msg);
+          free_process(data);
+          return NULL;
+        }
+        data->priority = (int)value;
+      }
+      else if(sched_opts && strcmp(p_tok, "-t") == 0) {
+        long value = 0;
+        p_tok = strtok(NULL, " ");
+        if(p_tok == NULL || parse_long(p_tok, &value) != 0 || value < MIN_TICKETS || value > MAX_TICKETS) {
+          sprintf(g_status_msg, "-t needs a ticket count from %d to %d.", MIN_TICKETS, MAX_TICKETS);
+          print_warning(g_status_msg);
+          free_process(data);
+          return NULL;
+        }
+        data->tickets = (int)value;
+      }
+      else if(sched_opts && (strcmp(p_tok, "-d") == 0 || strcmp(p_tok, "-r") == 0)) {
+        long *usec = (p_tok[1] == 'd') ? &data->deadline_usec : &data->runtime_usec;
+        char flag = p_tok[1];
+        p_tok = strtok(NULL, " ");
+        if(p_tok == NULL || parse_usec(p_tok, usec) != 0 || *usec <= 0) {
+          sprintf(g_status_msg, "-%c needs a time, eg. 500ms, 2s or 800us.", flag);
+          print_warning(g_status_msg);
+          free_process(data);
+          return NULL;
+        }
+      }
+      else if(sched_opts) {
+        sprintf(g_status_msg, "Unknown scheduler option %s after --.", p_tok);
+        print_warning(g_status_msg);
+        free_process(data);
+        return NULL;
+      }
       else {
         data->argv[arg++] = p_tok; // All pointers reference data->input_toks
       }
     }
   } while(p_tok != NULL);
 
+  // A deadline job needs both halves, and can't need more CPU than it has time
+  if((data->deadline_usec > 0) != (data->runtime_usec > 0) || data->runtime_usec > data->deadline_usec) {
+    print_warning("Deadline jobs need -- -d DEADLINE -r RUNTIME, with RUNTIME no longer than DEADLINE.");
+    free_process(data);
+    return NULL;
+  }
+
   return data;
 }
 
@@ -319,10 +510,50 @@ static process_data_t *initialize_data(const char *str) {
   strncpy(data->input_toks, str, MAX_CMD); // This you strtok.
   data->pid = 0;     // For safety, this should never be -1 (if you kill -1, you kill all owned processes)
   data->next = NULL; // For the Jobs Queue Membership
+  data->priority = DEFAULT_PRIORITY; // Weight under the fair policy
+  data->tickets = DEFAULT_TICKETS; // Share under the stride and lottery policies
+  data->deadline_usec = 0; // Not a deadline job
+  data->runtime_usec = 0;
 
   return data;
 }
 
+/* Converts a whole string to a number, returns 0 on success or -1 if it isn't one */
+static int parse_long(char *str, long *value) {
+  char *end_ptr = str;
+  errno = 0;
+  *value = strtol(str, &end_ptr, 10);
+  if(errno || end_ptr == str || *end_ptr != '\0') {
+    return -1;
+  }
+  return 0;
+}
+
+/* Converts a time with a us, ms or s suffix (ms if none) to usec, returns 0 on success or -1 if it isn't one */
+static int parse_usec(char *str, long *usec) {
+  char *end_ptr = str;
+  long scale = 1000;
+  errno = 0;
+  *usec = strtol(str, &end_ptr, 10);
+  if(errno != 0 || end_ptr == str) {
+    return -1;
+  }
+  if(strcmp(end_ptr, "us") == 0) {
+    scale = 1;
+  }
+  else if(strcmp(end_ptr, "s") == 0) {
+    scale = 1000000;
+  }
+  else if(*end_ptr != '\0' && strcmp(end_ptr, "ms") != 0) {
+    return -1;
+  }
+  if(*usec > LONG_MAX / scale) {
+    return -1;
+  }
+  *usec *= scale;
+  return 0;
+}
+
 /* Return 1 if the string is entirely whitespace */
 static int is_whitespace(char *str) {
   int i = 0;
@@ -365,6 +596,38 @@ static void print_help() {
   print_status(g_status_msg);
   sprintf(g_status_msg, "| delaytime X Sets the delaytime to X usec.");
   print_status(g_status_msg);
+  sprintf(g_status_msg, "| mlfq N [B] [Q..] Use N MLFQ levels, boost every B ticks, Q quantum per level.");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| mlfq off    Returns to the classic High/Low queues.");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| policy X    Switches every CPU to Scheduling Policy X (policy alone lists them).");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| CMD ARGS -- OPTS Scheduler options go after --, everything before it is CMD's own.");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| CMD -- -p N Runs CMD at priority N (%d-%d, default %d), its CPU share under the fair policy.", MIN_PRIORITY, MAX_PRIORITY, DEFAULT_PRIORITY);
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| CMD -- -t N Gives CMD N tickets (%d-%d, default %d), its CPU share under the stride and lottery policies.", MIN_TICKETS, MAX_TICKETS, DEFAULT_TICKETS);
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| CMD -- -d D -r R Runs CMD as a deadline job: done within D, needing R of CPU (eg. -- -d 5000ms -r 800ms).");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| deadline X  Admits deadline jobs up to X%% of each CPU (deadline alone shows the total).");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| cpus X      Runs processes on X virtual CPUs at once.");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| trace FILE  Writes the scheduler event trace to FILE as Chrome/Perfetto JSON (trace clear empties it).");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| latency     Prints scheduling latency/quantum gap percentiles (latency reset clears them).");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| stats       Prints CPU time, wait, response and turnaround of finished jobs.");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| timing      Prints quantum overrun/jitter stats (timing reset clears them).");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| affinity    Toggles pinning processes to their CPU's host core.");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| adapt       Toggles shorter slices for I/O-bound jobs and longer ones for CPU-bound jobs.");
+  print_status(g_status_msg);
+  sprintf(g_status_msg, "| probe       Toggles parking jobs found asleep %dms into a quantum and running the next one.", PARK_PROBE_USEC / 1000);
+  print_status(g_status_msg);
   sprintf(g_status_msg, "| quit        Exits TRILBY-VM.");
   print_status(g_status_msg);
   sprintf(g_status_msg, "+------------------");
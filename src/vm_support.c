@@ -93,9 +93,17 @@ void print_op_debug(Op_schedule_s *schedule) {
     return;
   }
   print_debug("Printing the Current Schedule Status...");
+  sprintf(g_status_msg, "...[Ready - Critical Queue - %d Processes]", op_get_count(schedule->ready_queue_critical));
+  print_debug(g_status_msg);
+  print_op_queue_debug(schedule->ready_queue_critical);
   sprintf(g_status_msg, "...[Ready - High Priority Queue - %d Processes]", op_get_count(schedule->ready_queue_high));
   print_debug(g_status_msg);
   print_op_queue_debug(schedule->ready_queue_high);
+  for(int i = 1; i < schedule->mlfq.levels - 1; i++) {
+    sprintf(g_status_msg, "...[Ready - Level %d Queue - %d Processes]", i, op_get_count(schedule->ready_queues[i]));
+    print_debug(g_status_msg);
+    print_op_queue_debug(schedule->ready_queues[i]);
+  }
   sprintf(g_status_msg, "...[Ready - Low Priority Queue - %d Processes]", op_get_count(schedule->ready_queue_low));
   print_debug(g_status_msg);
   print_op_queue_debug(schedule->ready_queue_low);
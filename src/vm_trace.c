@@ -0,0 +1,143 @@
+/*
+ * - vm_trace.c (Trilby VM)
+ * Always-on binary trace of scheduler events.
+ * - Events go into a fixed ring of TRACE_EVENTS slots, the oldest are overwritten.
+ * - Recording is one atomic add plus a slot write: no locks, no allocation.
+ * - trace_dump_chrome writes the ring as Chrome trace-event JSON (open it in Perfetto).
+ */
+
+// System Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// Local Includes
+#include "vm_trace.h"
+#include "op_sched.h"
+
+#if (TRACE_EVENTS & (TRACE_EVENTS - 1)) != 0
+#error "TRACE_EVENTS must be a power of 2"
+#endif
+
+// Globals
+static Trace_event_s trace_ring[TRACE_EVENTS];
+static unsigned long trace_head = 0; // Total events ever recorded (next ring position)
+static char *trace_names[OP_EV_COUNT] = {"add", "select", "promote", "resume", "suspend", "exit", "terminate"};
+
+// Records one event.  Safe from any thread (and the SIGCHLD handler), never blocks or allocates.
+void trace_record(int event, int cpu, pid_t pid, int queue) {
+  unsigned long pos = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+  Trace_event_s *slot = &trace_ring[pos & (TRACE_EVENTS - 1)];
+
+  __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED); // Torn until the final store below
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->ts_ns = op_now_ns();
+  slot->pid = pid;
+  slot->event = (unsigned char)event;
+  slot->queue = (signed char)queue;
+  slot->cpu = (unsigned short)cpu;
+  __atomic_store_n(&slot->seq, (unsigned int)(pos + 1), __ATOMIC_RELEASE);
+}
+
+// Returns how many events are held in the ring right now
+unsigned long trace_count() {
+  unsigned long head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  return (head > TRACE_EVENTS) ? TRACE_EVENTS : head;
+}
+
+// Forgets every recorded event
+void trace_clear() {
+  for(int i = 0; i < TRACE_EVENTS; i++) {
+    __atomic_store_n(&trace_ring[i].seq, 0, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&trace_head, 0, __ATOMIC_RELEASE);
+}
+
+// Writes one Chrome trace event.  Runs are B/E slices named by PID on the CPU's track, everything else is an instant.
+static void trace_write_event(FILE *fp, Trace_event_s *ev, unsigned long long base, char phase, int *first) {
+  char name[32] = {0};
+
+  if(phase == 'i') {
+    snprintf(name, sizeof(name), "%s", trace_names[ev->event]);
+  }
+  else {
+    snprintf(name, sizeof(name), "PID %d", ev->pid);
+  }
+  fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"sched\",\"ph\":\"%c\",%s\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"pid\":%d,\"event\":\"%s\",\"queue\":%d}}",
+      *first ? "" : ",", name, phase, (phase == 'i') ? "\"s\":\"t\"," : "", (ev->ts_ns - base) / 1e3, ev->cpu, ev->pid, trace_names[ev->event], ev->queue);
+  *first = 0;
+}
+
+// Dumps the ring, oldest event first, to path as Chrome trace-event JSON.
+// Recording carries on while this runs; slots overwritten mid-dump are skipped.
+// Returns the number of events written or -1 on any error.
+int trace_dump_chrome(char *path) {
+  unsigned long head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  unsigned long start = (head > TRACE_EVENTS) ? head - TRACE_EVENTS : 0;
+  Trace_event_s *events = NULL;
+  pid_t running[MAX_CPUS] = {0}; // PID with an open B slice on each CPU track
+  unsigned long long base = 0;
+  int count = 0, first = 1;
+  FILE *fp = NULL;
+
+  events = malloc((head - start + 1) * sizeof(Trace_event_s));
+  if(events == NULL) {
+    return -1;
+  }
+  // Copy out first, keeping only slots still holding the event we expect
+  for(unsigned long pos = start; pos < head; pos++) {
+    Trace_event_s *slot = &trace_ring[pos & (TRACE_EVENTS - 1)];
+    if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (unsigned int)(pos + 1)) {
+      continue;
+    }
+    events[count] = *slot;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == (unsigned int)(pos + 1) && events[count].event < OP_EV_COUNT) {
+      count++;
+    }
+  }
+
+  fp = fopen(path, "w");
+  if(fp == NULL) {
+    free(events);
+    return -1;
+  }
+  // Ring order is claim order, not timestamp order (a writer can be preempted between the two),
+  //  so the earliest event is the base or the unsigned offsets below would wrap
+  base = (count > 0) ? events[0].ts_ns : 0;
+  for(int i = 1; i < count; i++) {
+    if(events[i].ts_ns < base) {
+      base = events[i].ts_ns;
+    }
+  }
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for(int cpu = 0; cpu < MAX_CPUS; cpu++) { // Name the CPU tracks that show up
+    for(int i = 0; i < count; i++) {
+      if(events[i].cpu == cpu) {
+        fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"CPU %d\"}}", first ? "" : ",", cpu, cpu);
+        first = 0;
+        break;
+      }
+    }
+  }
+  for(int i = 0; i < count; i++) {
+    Trace_event_s *ev = &events[i];
+    int cpu = ev->cpu % MAX_CPUS;
+    if(ev->event == OP_EV_RESUME) {
+      trace_write_event(fp, ev, base, 'B', &first);
+      running[cpu] = ev->pid;
+      continue;
+    }
+    // A suspend, or an exit of the running PID, closes its slice
+    if(running[cpu] == ev->pid && ev->pid != 0 && (ev->event == OP_EV_SUSPEND || ev->event == OP_EV_EXIT || ev->event == OP_EV_TERMINATE)) {
+      trace_write_event(fp, ev, base, 'E', &first);
+      running[cpu] = 0;
+    }
+    if(ev->event != OP_EV_SUSPEND) {
+      trace_write_event(fp, ev, base, 'i', &first);
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+  free(events);
+  return count;
+}